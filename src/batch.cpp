@@ -0,0 +1,183 @@
+#include <chrono>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include "safewindows.h"
+#endif
+#include "batch.h"
+#include "system.h"
+#include "cpubus.h"
+#include "savestate.h"
+
+static uint64_t hashMemory(const byte *data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// best effort, the batch still runs if the platform won't pin
+static void pinCurrentThread(unsigned core) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+#elif defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << (core % (sizeof(DWORD_PTR) * 8)));
+#else
+    (void)core;
+#endif
+}
+
+BatchRunner::BatchRunner(const BatchOptions &options) : remaining(0) {
+    this->options = options;
+    if (this->options.framesPerTask == 0) {
+        this->options.framesPerTask = 1;
+    }
+
+    this->threadCount = options.threads;
+    if (this->threadCount == 0) {
+        this->threadCount = std::thread::hardware_concurrency();
+    }
+    if (this->threadCount == 0) {
+        this->threadCount = 1;
+    }
+
+    this->romPath = nullptr;
+    this->queues = new Queue[this->threadCount];
+    this->totalFrames = 0;
+    this->seconds = 0;
+}
+
+BatchRunner::~BatchRunner() {
+    for (System *system : systems) {
+        delete system;
+    }
+
+    delete[] queues;
+}
+
+bool BatchRunner::run(const char *romPath) {
+    this->romPath = romPath;
+
+    systems.assign(options.instances, nullptr);
+    results.assign(options.instances, BatchResult());
+    for (unsigned i = 0; i < options.instances; i++) {
+        queues[i % threadCount].instances.push_back(i);
+    }
+    remaining = options.instances;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back(&BatchRunner::work, this, i);
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool allLoaded = true;
+    totalFrames = 0;
+    for (const BatchResult &result : results) {
+        allLoaded = allLoaded && result.loaded;
+        totalFrames += result.frameCount;
+    }
+
+    return allLoaded;
+}
+
+void BatchRunner::work(unsigned index) {
+    if (options.pinThreads) {
+        pinCurrentThread(index);
+    }
+
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        unsigned instance;
+        if (!takeInstance(index, &instance)) {
+            // everything left is being run by other workers right now
+            std::this_thread::yield();
+            continue;
+        }
+
+        runSlice(index, instance);
+    }
+}
+
+// the newest instance from our own queue, or else the oldest from someone else's
+bool BatchRunner::takeInstance(unsigned index, unsigned *instance) {
+    {
+        Queue *own = &queues[index];
+        std::lock_guard<std::mutex> guard(own->lock);
+        if (!own->instances.empty()) {
+            *instance = own->instances.back();
+            own->instances.pop_back();
+            return true;
+        }
+    }
+
+    for (unsigned i = 1; i < threadCount; i++) {
+        Queue *victim = &queues[(index + i) % threadCount];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->instances.empty()) {
+            *instance = victim->instances.front();
+            victim->instances.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void BatchRunner::runSlice(unsigned index, unsigned instance) {
+    BatchResult *result = &results[instance];
+    System *system = systems[instance];
+
+    // created by whichever worker gets to it first, so loading is spread out too
+    if (system == nullptr) {
+        system = new System;
+        result->error = system->loadRom(romPath);
+        if (result->error) {
+            delete system;
+            remaining.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+
+        system->start();
+        systems[instance] = system;
+        result->loaded = true;
+    }
+
+    unsigned end = result->frameCount + options.framesPerTask;
+    if (end > options.frames) {
+        end = options.frames;
+    }
+
+    for (unsigned frame = result->frameCount; frame < end; frame++) {
+        if (options.frameCallback != nullptr) {
+            options.frameCallback(system, instance, frame, options.userData);
+        }
+        system->runFrame();
+    }
+    result->frameCount = end;
+
+    if (end < options.frames) {
+        Queue *own = &queues[index];
+        std::lock_guard<std::mutex> guard(own->lock);
+        own->instances.push_back(instance);
+        return;
+    }
+
+    result->ramHash = hashMemory(system->getBus()->getRam(), CPU_RAM_SIZE);
+
+    // finished instances give their memory back straight away, there may be thousands
+    delete system;
+    systems[instance] = nullptr;
+    remaining.fetch_sub(1, std::memory_order_release);
+}
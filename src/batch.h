@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class System;
+
+// Called before every frame an instance runs, to feed it that frame's input.
+// Calls for the same instance never overlap, but different instances run concurrently.
+typedef void (*BatchFrameCallback)(System *system, unsigned instance, unsigned frame, void *userData);
+
+struct BatchOptions {
+    unsigned instances;
+    unsigned frames;            // per instance
+    unsigned threads;           // 0 to use one per core
+    unsigned framesPerTask;     // how many frames an instance runs before going back in a queue
+    bool pinThreads;            // pin each worker to the core with the same index
+
+    BatchFrameCallback frameCallback;
+    void *userData;
+};
+
+struct BatchResult {
+    bool loaded;
+    // why the instance didn't load, left to the caller to report
+    const char *error;
+    unsigned frameCount;
+    uint64_t ramHash;           // 64-bit FNV-1a of CPU RAM after the last frame
+};
+
+// Runs many independent Systems on the same ROM. Each worker has its own queue of instances
+// to run a slice of frames for, and steals from the front of the others' when it runs dry.
+class BatchRunner {
+public:
+    BatchRunner(const BatchOptions &options);
+    ~BatchRunner();
+
+    bool run(const char *romPath);
+
+    const BatchResult *getResults() const { return this->results.data(); }
+    unsigned getThreadCount() const { return this->threadCount; }
+    uint64_t getTotalFrames() const { return this->totalFrames; }
+    double getSeconds() const { return this->seconds; }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<unsigned> instances;
+    };
+
+    void work(unsigned index);
+    bool takeInstance(unsigned index, unsigned *instance);
+    void runSlice(unsigned index, unsigned instance);
+
+    BatchOptions options;
+    unsigned threadCount;
+    const char *romPath;
+
+    std::vector<System *> systems;
+    std::vector<BatchResult> results;
+    Queue *queues;
+    std::atomic<unsigned> remaining;
+
+    uint64_t totalFrames;
+    double seconds;
+};
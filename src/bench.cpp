@@ -0,0 +1,488 @@
+// Microbenchmarks for the CPU, bus and pixel hot paths, run against a generated ROM so no real game is needed.
+// Results are written as JSON so they can be compared between commits.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "system.h"
+#include "cpu.h"
+#include "cpubus.h"
+#include "mapper.h"
+#include "rom.h"
+#include "chrcache.h"
+#include "ppu.h"
+#include "ppubus.h"
+#include "pixelkernels.h"
+#include "ntscfilter.h"
+#include "scalefilter.h"
+#include "romhash.h"
+
+// each benchmark is run this many times and the fastest run is kept, to filter out noise
+const unsigned BENCH_REPEATS = 5;
+
+const address BENCH_SEGMENT_SIZE = 0x100;
+const unsigned BENCH_PRG_SIZE = 0x8000;
+
+struct BenchResult {
+    std::string name;
+    double nsPerOp;
+    uint64_t ops;
+};
+
+// keeps the compiler from dropping reads whose results are otherwise unused
+static volatile unsigned benchSink;
+
+template <typename Body>
+static void bench(std::vector<BenchResult> &results, const char *name, uint64_t ops, Body body) {
+    double best = 0;
+
+    for (unsigned repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        if (repeat == 0 || ns < best) {
+            best = ns;
+        }
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.nsPerOp = best / ops;
+    result.ops = ops;
+    results.push_back(result);
+
+    printf("%-24s %10.2f ns/op %14.0f ops/sec\n", name, result.nsPerOp, 1e9 / result.nsPerOp);
+}
+
+// filters are timed a frame at a time, so their cost is also given the way a frame budget is
+static void benchFilter(std::vector<BenchResult> &results, const char *name, VideoFilter *filter, const uint16_t *pixels) {
+    const uint64_t frames = 64;
+
+    bench(results, name, frames, [&]() {
+        for (uint64_t frame = 0; frame < frames; frame++) {
+            benchSink = filter->apply(pixels, static_cast<unsigned>(frame))[frame];
+        }
+    });
+
+    printf("%-24s %10.3f ms/frame\n", "", results.back().nsPerOp / 1e6);
+}
+
+// A class of instructions, repeated to fill one segment of PRG and looped back with a JMP
+struct BenchOpcodeClass {
+    const char *name;
+    byte code[8];
+    unsigned codeLength;
+};
+
+static const BenchOpcodeClass opcodeClasses[] = {
+    { "cpu.step.load",      { 0xA5, 0x10, 0xAD, 0x00, 0x03, 0xBD, 0x00, 0x03 }, 8 }, // LDA zp; LDA abs; LDA abs,X
+    { "cpu.step.store",     { 0x85, 0x10, 0x8D, 0x00, 0x03, 0x9D, 0x00, 0x03 }, 8 }, // STA zp; STA abs; STA abs,X
+    { "cpu.step.alu",       { 0x69, 0x01, 0x29, 0xFF, 0x49, 0x5A, 0xC9, 0x33 }, 8 }, // ADC #; AND #; EOR #; CMP #
+    { "cpu.step.rmw",       { 0xE6, 0x10, 0x06, 0x11, 0x46, 0x12, 0xC6, 0x13 }, 8 }, // INC zp; ASL zp; LSR zp; DEC zp
+    { "cpu.step.implied",   { 0xAA, 0xE8, 0xCA, 0x8A },                         4 }, // TAX; INX; DEX; TXA
+    { "cpu.step.branch",    { 0x90, 0x00, 0xB0, 0x00 },                         4 }, // BCC taken; BCS not taken
+    { "cpu.step.stack",     { 0x48, 0x68, 0x08, 0x28 },                         4 }, // PHA; PLA; PHP; PLP
+    { "cpu.step.indirect",  { 0xB1, 0x20, 0x91, 0x20, 0xA1, 0x20 },             6 }, // LDA (zp),Y; STA (zp),Y; LDA (zp,X)
+};
+
+const unsigned NUM_OPCODE_CLASSES = sizeof(opcodeClasses) / sizeof(opcodeClasses[0]);
+
+static address getSegmentStart(unsigned index) {
+    return static_cast<address>(0x8000 + index * BENCH_SEGMENT_SIZE);
+}
+
+// an NROM image with one segment per opcode class, plus a JSR/RTS segment after them
+static bool writeSyntheticRom(const char *path) {
+    std::vector<byte> prg(BENCH_PRG_SIZE, 0xEA);
+
+    for (unsigned i = 0; i < NUM_OPCODE_CLASSES; i++) {
+        const BenchOpcodeClass *opcodeClass = &opcodeClasses[i];
+        address start = getSegmentStart(i);
+        byte *segment = &prg[start - 0x8000];
+
+        unsigned offset = 0;
+        while (offset + opcodeClass->codeLength <= BENCH_SEGMENT_SIZE - 3) {
+            memcpy(segment + offset, opcodeClass->code, opcodeClass->codeLength);
+            offset += opcodeClass->codeLength;
+        }
+
+        segment[offset++] = 0x4C; // JMP start
+        segment[offset++] = start & 0xFF;
+        segment[offset++] = start >> 8;
+    }
+
+    // JSR to an RTS half a segment away, over and over
+    address start = getSegmentStart(NUM_OPCODE_CLASSES);
+    address subroutine = start + BENCH_SEGMENT_SIZE / 2;
+    byte *segment = &prg[start - 0x8000];
+    unsigned offset = 0;
+    while (offset + 3 <= BENCH_SEGMENT_SIZE / 2 - 3) {
+        segment[offset++] = 0x20;
+        segment[offset++] = subroutine & 0xFF;
+        segment[offset++] = subroutine >> 8;
+    }
+    segment[offset++] = 0x4C;
+    segment[offset++] = start & 0xFF;
+    segment[offset++] = start >> 8;
+    prg[subroutine - 0x8000] = 0x60;
+
+    prg[VECTOR_RESET - 0x8000] = 0x00;
+    prg[VECTOR_RESET - 0x8000 + 1] = 0x80;
+
+    InesHeader header;
+    memset(&header, 0, sizeof(InesHeader));
+    memcpy(header.magic, "NES\x1A", 4);
+    header.prgRomSize = BENCH_PRG_SIZE / 0x4000;
+    header.chrRomSize = 1;
+
+    // arbitrary, but not all zero, so decoding it isn't trivially predictable
+    std::vector<byte> chr(0x2000);
+    for (unsigned i = 0; i < chr.size(); i++) {
+        chr[i] = static_cast<byte>(i * 37 + (i >> 8));
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+
+    fwrite(&header, sizeof(InesHeader), 1, f);
+    fwrite(prg.data(), 1, prg.size(), f);
+    fwrite(chr.data(), 1, chr.size(), f);
+    fclose(f);
+
+    return true;
+}
+
+// runs the CPU from the given address until it has executed the given number of instructions
+static void benchCpu(std::vector<BenchResult> &results, const char *name, Cpu *cpu, CpuBus *bus, address pc, uint64_t instructions) {
+    bench(results, name, instructions, [=]() {
+        cpu->registers.a = 0x00;
+        cpu->registers.x = 0x01;
+        cpu->registers.y = 0x02;
+        cpu->registers.s = 0xFD;
+        cpu->registers.p = 0x24;
+        cpu->registers.pc = pc;
+
+        // pointer used by the indirect modes
+        bus->write(0x0020, 0x00);
+        bus->write(0x0021, 0x03);
+
+        uint64_t end = cpu->getTotalInstructions() + instructions;
+        while (cpu->getTotalInstructions() < end) {
+            cpu->step();
+        }
+    });
+}
+
+static bool writeJson(const char *path, const char *label, const std::vector<BenchResult> &results) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"label\": \"%s\",\n", label);
+    fprintf(f, "  \"repeats\": %u,\n", BENCH_REPEATS);
+    fprintf(f, "  \"benchmarks\": [\n");
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &result = results[i];
+        fprintf(f, "    { \"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f }%s\n",
+                result.name.c_str(), static_cast<unsigned long long>(result.ops), result.nsPerOp, 1e9 / result.nsPerOp,
+                i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+    fclose(f);
+
+    return true;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--out path] [--label text] [--rom path]\n", program);
+}
+
+int main(int argc, char **argv) {
+    const char *outPath = "bench.json";
+    const char *label = "";
+    const char *romPath = "armadanes-bench.nes";
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (!strcmp(argv[i], "--label") && i + 1 < argc) {
+            label = argv[++i];
+        } else if (!strcmp(argv[i], "--rom") && i + 1 < argc) {
+            romPath = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!writeSyntheticRom(romPath)) {
+        fprintf(stderr, "Failed to write %s\n", romPath);
+        return 1;
+    }
+
+    System system;
+    const char *loadError = system.loadRom(romPath);
+    if (loadError) {
+        fprintf(stderr, "Failed to load ROM %s: %s\n", romPath, loadError);
+        return 1;
+    }
+
+    system.start();
+
+    std::vector<BenchResult> results;
+    CpuBus *bus = system.getBus();
+    Cpu *cpu = system.getCpu();
+    Mapper *mapper = system.getMapper();
+
+    const uint64_t busOps = 1U << 22U;
+
+    bench(results, "bus.read.direct", busOps, [=]() {
+        unsigned sum = 0;
+        for (uint64_t i = 0; i < busOps; i++) {
+            sum += bus->read(static_cast<address>(i & 0x1FFF));
+        }
+        benchSink = sum;
+    });
+
+    // cartridge fetches, through the banks the mapper installed on the page tables
+    bench(results, "bus.read.prg", busOps, [=]() {
+        unsigned sum = 0;
+        for (uint64_t i = 0; i < busOps; i++) {
+            sum += bus->read(static_cast<address>(0x8000 | (i & 0x7FFF)));
+        }
+        benchSink = sum;
+    });
+
+    PpuBus *ppuBus = system.getPpu()->getBus();
+    bench(results, "ppubus.read.chr", busOps, [=]() {
+        unsigned sum = 0;
+        for (uint64_t i = 0; i < busOps; i++) {
+            sum += ppuBus->read(static_cast<address>(i & 0x1FFF));
+        }
+        benchSink = sum;
+    });
+
+    bench(results, "bus.write.direct", busOps, [=]() {
+        for (uint64_t i = 0; i < busOps; i++) {
+            bus->write(static_cast<address>(i & 0x1FFF), static_cast<byte>(i));
+        }
+    });
+
+    // PRG writes are mapper register writes, which catch the PPU up first
+    bench(results, "bus.write.mapper", busOps, [=]() {
+        unsigned sum = 0;
+        for (uint64_t i = 0; i < busOps; i++) {
+            sum += bus->write(static_cast<address>(0x8000 | (i & 0x7FFF)), static_cast<byte>(i));
+        }
+        benchSink = sum;
+    });
+
+    bench(results, "mapper.nrom.readPrg", busOps, [=]() {
+        unsigned sum = 0;
+        for (uint64_t i = 0; i < busOps; i++) {
+            sum += mapper->readPrg(static_cast<address>(i & 0x7FFF));
+        }
+        benchSink = sum;
+    });
+
+    const uint64_t stackOps = 1U << 20U;
+
+    bench(results, "cpu.pushStack+popStack", stackOps, [=]() {
+        unsigned sum = 0;
+        cpu->registers.s = 0xFD;
+        for (uint64_t i = 0; i < stackOps; i++) {
+            cpu->pushStack(static_cast<byte>(i));
+            sum += cpu->popStack();
+        }
+        benchSink = sum;
+    });
+
+    const uint64_t instructions = 1U << 20U;
+
+    for (unsigned i = 0; i < NUM_OPCODE_CLASSES; i++) {
+        benchCpu(results, opcodeClasses[i].name, cpu, bus, getSegmentStart(i), instructions);
+    }
+    benchCpu(results, "cpu.step.jsr+rts", cpu, bus, getSegmentStart(NUM_OPCODE_CLASSES), instructions);
+
+    // a frame's worth of background pattern rows, 33 tiles per line as with fine scrolling,
+    // combined into pixels with and without the pre-decoded cache
+    const uint64_t chrFrames = 256;
+    const unsigned tilesPerLine = PPU_WIDTH / 8 + 1;
+    const Rom *rom = system.getRom();
+    std::vector<byte> line((tilesPerLine) * 8);
+
+    bench(results, "chr.frame.bitplanes", chrFrames, [&]() {
+        for (uint64_t frame = 0; frame < chrFrames; frame++) {
+            for (unsigned y = 0; y < PPU_HEIGHT; y++) {
+                for (unsigned i = 0; i < tilesPerLine; i++) {
+                    uint32_t offset = (((i * 7 + y) & 0x1FF) * CHR_TILE_SIZE + (y & 7)) % rom->chrRomSize;
+                    byte low = rom->chrRom[offset];
+                    byte high = rom->chrRom[offset + 8];
+                    for (unsigned bit = 0; bit < 8; bit++) {
+                        line[i * 8 + bit] = ((low >> (7 - bit)) & 1) | (((high >> (7 - bit)) & 1) << 1);
+                    }
+                }
+                benchSink = line[y];
+            }
+        }
+    });
+
+    bench(results, "chr.frame.cached", chrFrames, [&]() {
+        for (uint64_t frame = 0; frame < chrFrames; frame++) {
+            for (unsigned y = 0; y < PPU_HEIGHT; y++) {
+                for (unsigned i = 0; i < tilesPerLine; i++) {
+                    uint32_t offset = (((i * 7 + y) & 0x1FF) * CHR_TILE_SIZE + (y & 7)) % rom->chrRomSize;
+                    memcpy(&line[i * 8], rom->chrCache.getRow(offset), 8);
+                }
+                benchSink = line[y];
+            }
+        }
+    });
+
+    // a frame of random background and sprite lines, composited and then converted to RGBA by each
+    // kernel the CPU supports, whose output armadanes-kerneltest checks against the scalar kernels
+    const uint64_t composeFrames = 256;
+    const unsigned framePixels = PPU_WIDTH * PPU_HEIGHT;
+    std::vector<byte> backgroundFrame(framePixels);
+    std::vector<byte> spriteFrame(framePixels);
+    std::vector<uint16_t> pixels(framePixels);
+    std::vector<uint32_t> rgba(framePixels);
+    std::vector<uint32_t> rgbaPalette(RGBA_PALETTE_SIZE);
+    byte palette[0x20];
+    buildRgbaPalette(rgbaPalette.data());
+
+    uint32_t seed = 0x2C02;
+    for (unsigned i = 0; i < framePixels; i++) {
+        seed = seed * 1103515245 + 12345;
+        byte value = (seed >> 16) & 3;
+        backgroundFrame[i] = value ? static_cast<byte>(value | ((seed >> 18) & 0xC)) : 0;
+        spriteFrame[i] = (seed >> 24) & 0x3F;
+        if (!(spriteFrame[i] & 3)) {
+            spriteFrame[i] = 0;
+        }
+    }
+    for (unsigned i = 0; i < 0x20; i++) {
+        palette[i] = static_cast<byte>((i * 13 + 5) & 0x3F);
+    }
+
+    for (int level = 0; level < PixelKernelLevel_Count; level++) {
+        const PixelKernels *kernels = getPixelKernels(level);
+        if (!kernels) {
+            continue;
+        }
+
+        // each line with its own mask and emphasis, so those are covered as well
+        auto compose = [&]() {
+            unsigned hits = 0;
+            for (unsigned y = 0; y < PPU_HEIGHT; y++) {
+                unsigned offset = y * PPU_WIDTH;
+                byte colorMask = (y & 1) ? 0x30 : 0x3F;
+                uint16_t emphasis = static_cast<uint16_t>((y & 7) << PPU_EMPHASIS_SHIFT);
+                hits += kernels->composite(&backgroundFrame[offset], &spriteFrame[offset], palette,
+                                           &pixels[offset], PPU_WIDTH, colorMask, emphasis);
+            }
+            return hits;
+        };
+
+        std::string name = std::string("ppu.compose.") + kernels->name;
+        bench(results, name.c_str(), composeFrames, [&]() {
+            for (uint64_t frame = 0; frame < composeFrames; frame++) {
+                benchSink = compose();
+            }
+        });
+
+        name = std::string("ppu.rgba.") + kernels->name;
+        bench(results, name.c_str(), composeFrames, [&]() {
+            for (uint64_t frame = 0; frame < composeFrames; frame++) {
+                kernels->convertToRgba(pixels.data(), rgba.data(), framePixels, rgbaPalette.data());
+                benchSink = rgba[frame];
+            }
+        });
+    }
+
+    // what the PPU adds to each frame so sinks can tell which rows changed
+    bench(results, "ppu.hashScanline.frame", composeFrames, [&]() {
+        uint64_t hash = 0;
+        for (uint64_t frame = 0; frame < composeFrames; frame++) {
+            for (unsigned y = 0; y < PPU_HEIGHT; y++) {
+                hash ^= hashScanline(&pixels[y * PPU_WIDTH]);
+            }
+        }
+        benchSink = static_cast<unsigned>(hash);
+    });
+
+    // the video filters over the last composited frame, on one thread and then on one per core.
+    // The frame is noise, which is close to the worst case for the scalers.
+    const unsigned filterThreads[] = { 1, 0 };
+
+    for (unsigned threads : filterThreads) {
+        for (unsigned scale = 2; scale <= 3; scale++) {
+            NtscFilter filter(scale, threads);
+            if (threads == 0 && filter.getThreadCount() == 1) {
+                break;
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "video.ntsc.x%u.%ut", scale, filter.getThreadCount());
+            benchFilter(results, name, &filter, pixels.data());
+        }
+
+        for (int type = 0; type < ScaleFilterType_Count; type++) {
+            ScaleFilter filter(type, threads);
+            if (threads == 0 && filter.getThreadCount() == 1) {
+                break;
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "video.%s.%ut", ScaleFilter::getName(type), filter.getThreadCount());
+            benchFilter(results, name, &filter, pixels.data());
+        }
+    }
+
+    const uint64_t loads = 256;
+
+    bench(results, "rom.load", loads, [&]() {
+        for (uint64_t i = 0; i < loads; i++) {
+            Rom rom(&system);
+            benchSink = rom.load(romPath) == nullptr;
+        }
+    });
+
+    // what a library scan pays per byte of ROM before it can look a game up
+    std::vector<byte> hashData(0x100000);
+    for (size_t i = 0; i < hashData.size(); i++) {
+        hashData[i] = static_cast<byte>(i * 37 + (i >> 11));
+    }
+
+    bench(results, "hash.crc32.byte", hashData.size(), [&]() {
+        benchSink = crc32(hashData.data(), hashData.size());
+    });
+
+    bench(results, "hash.sha1.byte", hashData.size(), [&]() {
+        Sha1 sha1;
+        byte digest[SHA1_SIZE];
+        sha1.update(hashData.data(), hashData.size());
+        sha1.finish(digest);
+        benchSink = digest[0];
+    });
+
+    if (!writeJson(outPath, label, results)) {
+        fprintf(stderr, "Failed to write %s\n", outPath);
+        return 1;
+    }
+
+    remove(romPath);
+    printf("Wrote %s\n", outPath);
+    return 0;
+}
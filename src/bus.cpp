@@ -6,6 +6,8 @@
 Bus::Bus() {
     this->mappings = nullptr;
     this->numMappings = 0;
+    memset(this->bankPages, 0, sizeof(this->bankPages));
+    rebuildPages();
 }
 
 Bus::~Bus() {
@@ -35,10 +37,40 @@ void Bus::mapCallback(address start, address end, BusMapReadCallback readCallbac
     addMapping(&mapping);
 }
 
+void Bus::mapBanked(address start, address end, BusMapReadCallback readCallback, BusMapWriteCallback writeCallback, void *userData) {
+    BusMapping mapping;
+    mapping.type = BusMappingType_Banked;
+    mapping.startAddress = start;
+    mapping.endAddress = end;
+    mapping.callback.readCallback = readCallback;
+    mapping.callback.writeCallback = writeCallback;
+    mapping.callback.userData = userData;
+
+    addMapping(&mapping);
+}
+
+void Bus::setBank(address start, unsigned size, const byte *dest) {
+    for (unsigned offset = 0; offset < size; offset += BUS_PAGE_SIZE) {
+        unsigned i = (start + offset) >> BUS_PAGE_SHIFT;
+        bankPages[i] = dest != nullptr ? dest + offset : nullptr;
+
+        // pages that aren't wholly banked are left to the slow path, which looks at bankPages itself
+        BusPage *page = &pages[i];
+        if (page->type == BusPageType_Banked || (page->type == BusPageType_Callback && page->mapping->type == BusMappingType_Banked)) {
+            page->type = dest != nullptr ? BusPageType_Banked : BusPageType_Callback;
+            page->dest = const_cast<byte *>(bankPages[i]);
+            page->mask = BUS_PAGE_SIZE - 1;
+        }
+    }
+}
+
 void Bus::addMapping(BusMapping *mapping) {
     size_t i = numMappings++;
     mappings = (BusMapping *)realloc(mappings, numMappings * sizeof(BusMapping));
     memcpy(&mappings[i], mapping, sizeof(BusMapping));
+
+    // realloc may have moved the mappings, so every page has to be redone
+    rebuildPages();
 }
 
 BusMapping *Bus::findMapping(address ptr, size_t *index) {
@@ -60,10 +92,126 @@ void Bus::resetMappings() {
     free(mappings);
     numMappings = 0;
     mappings = nullptr;
+    rebuildPages();
+}
+
+void Bus::rebuildPages() {
+    for (unsigned i = 0; i < BUS_NUM_PAGES; i++) {
+        BusPage *page = &pages[i];
+        address pageStart = i << BUS_PAGE_SHIFT;
+
+        page->dest = nullptr;
+        page->mask = 0;
+        page->mapping = nullptr;
+
+        // the page can only be resolved directly if every address in it goes to the same mapping,
+        // otherwise an earlier mapping or a partial overlap would be hidden
+        BusMapping *mapping = findMapping(pageStart);
+        bool uniform = true;
+        for (unsigned j = 1; j < BUS_PAGE_SIZE; j++) {
+            if (findMapping(pageStart + j) != mapping) {
+                uniform = false;
+                break;
+            }
+        }
+
+        if (!uniform) {
+            page->type = BusPageType_Mixed;
+            continue;
+        }
+
+        if (!mapping) {
+            page->type = BusPageType_Unmapped;
+            continue;
+        }
+
+        switch (mapping->type) {
+            case BusMappingType_Direct: {
+                unsigned size = mapping->direct.size;
+                unsigned offset = (pageStart - mapping->startAddress) % size;
+
+                if (offset + BUS_PAGE_SIZE <= size) {
+                    // the page lies within one repetition of the region
+                    page->type = BusPageType_Direct;
+                    page->dest = mapping->direct.dest + offset;
+                    page->mask = BUS_PAGE_SIZE - 1;
+                } else if (offset == 0 && (BUS_PAGE_SIZE % size) == 0 && (size & (size - 1)) == 0) {
+                    // the region is smaller than a page and repeats a whole number of times within it
+                    page->type = BusPageType_Direct;
+                    page->dest = mapping->direct.dest;
+                    page->mask = size - 1;
+                } else {
+                    page->type = BusPageType_Mixed;
+                }
+                break;
+            }
+
+            case BusMappingType_Callback: {
+                page->type = BusPageType_Callback;
+                page->mapping = mapping;
+                break;
+            }
+
+            case BusMappingType_Banked: {
+                page->type = bankPages[i] != nullptr ? BusPageType_Banked : BusPageType_Callback;
+                page->dest = const_cast<byte *>(bankPages[i]);
+                page->mask = BUS_PAGE_SIZE - 1;
+                page->mapping = mapping;
+                break;
+            }
+
+            default: {
+                page->type = BusPageType_Mixed;
+                break;
+            }
+        }
+    }
 }
 
 byte Bus::read(address ptr) {
-    BusMapping *mapping = findMapping(ptr);
+    const BusPage *page = &pages[ptr >> BUS_PAGE_SHIFT];
+
+    switch (page->type) {
+        case BusPageType_Direct:
+        case BusPageType_Banked: {
+            return page->dest[ptr & page->mask];
+        }
+
+        case BusPageType_Callback: {
+            return page->mapping->callback.readCallback(ptr - page->mapping->startAddress, page->mapping->callback.userData);
+        }
+
+        case BusPageType_Mixed: {
+            return readMapping(findMapping(ptr), ptr);
+        }
+    }
+
+    return 0;
+}
+
+bool Bus::write(address ptr, byte value) {
+    const BusPage *page = &pages[ptr >> BUS_PAGE_SHIFT];
+
+    switch (page->type) {
+        case BusPageType_Direct: {
+            page->dest[ptr & page->mask] = value;
+            return true;
+        }
+
+        case BusPageType_Callback:
+        case BusPageType_Banked: {
+            return page->mapping->callback.writeCallback(ptr - page->mapping->startAddress, value, page->mapping->callback.userData);
+        }
+
+        case BusPageType_Mixed: {
+            return writeMapping(findMapping(ptr), ptr, value);
+        }
+    }
+
+    return false;
+}
+
+byte Bus::readMapping(const BusMapping *mapping, address ptr) {
     if (!mapping) {
         return 0;
     }
@@ -78,13 +226,20 @@ byte Bus::read(address ptr) {
         case BusMappingType_Callback: {
             return mapping->callback.readCallback(offset, mapping->callback.userData);
         }
+
+        case BusMappingType_Banked: {
+            const byte *bank = bankPages[ptr >> BUS_PAGE_SHIFT];
+            if (bank != nullptr) {
+                return bank[ptr & (BUS_PAGE_SIZE - 1)];
+            }
+            return mapping->callback.readCallback(offset, mapping->callback.userData);
+        }
     }
 
     return 0;
 }
 
-bool Bus::write(address ptr, byte value) {
-    BusMapping *mapping = findMapping(ptr);
+bool Bus::writeMapping(const BusMapping *mapping, address ptr, byte value) {
     if (!mapping) {
         return false;
     }
@@ -97,7 +252,8 @@ bool Bus::write(address ptr, byte value) {
             return true;
         }
 
-        case BusMappingType_Callback: {
+        case BusMappingType_Callback:
+        case BusMappingType_Banked: {
             return mapping->callback.writeCallback(offset, value, mapping->callback.userData);
         }
     }
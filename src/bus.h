@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include "armadadef.h"
 
 enum {
@@ -7,6 +8,9 @@ enum {
     BusMappingType_Direct,
     // uses a callback to map
     BusMappingType_Callback,
+    // reads come from host memory installed a page at a time with setBank, for switchable
+    // cartridge banks, and writes go to a callback
+    BusMappingType_Banked,
 };
 
 // Function pointer type definitions for callback mappings.
@@ -33,6 +37,38 @@ struct BusMapping {
     };
 };
 
+enum {
+    // nothing is mapped anywhere in the page
+    BusPageType_Unmapped,
+    // the whole page is backed by host memory, mirroring already applied
+    BusPageType_Direct,
+    // the whole page is covered by a single callback mapping
+    BusPageType_Callback,
+    // the page is split between mappings, fall back to searching them
+    BusPageType_Mixed,
+    // reads are direct, writes go to the mapping's callback
+    BusPageType_Banked,
+};
+
+const unsigned BUS_PAGE_SHIFT = 8;
+const unsigned BUS_PAGE_SIZE = 1U << BUS_PAGE_SHIFT;
+const unsigned BUS_NUM_PAGES = 0x10000 >> BUS_PAGE_SHIFT;
+
+// Page table entry, rebuilt from the mappings whenever they change, so that
+// the common case of a read or write is a single index into the table
+struct BusPage {
+    int type;
+
+    // BusPageType_Direct and BusPageType_Banked: host memory for the start of
+    // the page, indexed by the low byte of the address masked with mask. Banked
+    // pages may be read only memory, but writes to them never go through dest.
+    byte *dest;
+    address mask;
+
+    // BusPageType_Callback and BusPageType_Banked: the mapping that covers the page
+    const BusMapping *mapping;
+};
+
 class Bus {
 public:
     Bus();
@@ -43,13 +79,27 @@ public:
 
     void mapMemory(address start, address end, byte *region, address size);
     void mapCallback(address start, address end, BusMapReadCallback readCallback, BusMapWriteCallback writeCallback, void *userData = nullptr);
+    // like mapCallback, but pages given host memory with setBank are read from it directly,
+    // the read callback only covers pages that have none
+    void mapBanked(address start, address end, BusMapReadCallback readCallback, BusMapWriteCallback writeCallback, void *userData = nullptr);
+
+    // Points size bytes from start, a whole number of pages, at host memory, or back at the read
+    // callback if dest is null. Only the pages' entries change, so a bank switch costs a few stores.
+    void setBank(address start, unsigned size, const byte *dest);
 
     void dump();
 private:
     void addMapping(BusMapping *mapping);
     BusMapping *findMapping(address ptr, size_t *index = nullptr);
     void resetMappings();
+    void rebuildPages();
+    byte readMapping(const BusMapping *mapping, address ptr);
+    bool writeMapping(const BusMapping *mapping, address ptr, byte value);
 
     BusMapping *mappings;
     size_t numMappings;
+
+    BusPage pages[BUS_NUM_PAGES];
+    // what setBank last installed for each page, kept across rebuilds of the page table
+    const byte *bankPages[BUS_NUM_PAGES];
 };
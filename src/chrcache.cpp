@@ -0,0 +1,56 @@
+#include "chrcache.h"
+
+ChrCache::ChrCache() {
+    this->rows = nullptr;
+    this->flippedRows = nullptr;
+    this->size = 0;
+}
+
+ChrCache::~ChrCache() {
+    delete[] rows;
+    delete[] flippedRows;
+}
+
+void ChrCache::build(const byte *chr, uint32_t size) {
+    delete[] rows;
+    delete[] flippedRows;
+
+    // one pixel per bit of the low bitplane, so the cache is four times the size of CHR
+    uint32_t count = (size / CHR_TILE_SIZE) * CHR_TILE_ROWS * 8;
+    this->rows = new byte[count];
+    this->flippedRows = new byte[count];
+    this->size = size;
+
+    refresh(chr);
+}
+
+void ChrCache::refresh(const byte *chr) {
+    for (uint32_t tile = 0; tile + CHR_TILE_SIZE <= size; tile += CHR_TILE_SIZE) {
+        for (uint32_t row = 0; row < CHR_TILE_ROWS; row++) {
+            decodeRow(chr, tile + row);
+        }
+    }
+}
+
+void ChrCache::update(const byte *chr, uint32_t offset) {
+    if (offset >= size) {
+        return;
+    }
+
+    // either bitplane may have changed, the row is keyed by the low one
+    decodeRow(chr, (offset & ~(CHR_TILE_SIZE - 1)) | (offset & (CHR_TILE_ROWS - 1)));
+}
+
+void ChrCache::decodeRow(const byte *chr, uint32_t offset) {
+    byte low = chr[offset];
+    byte high = chr[offset + CHR_TILE_ROWS];
+    byte *row = rows + getRowIndex(offset) * CHR_TILE_ROWS;
+    byte *flipped = flippedRows + getRowIndex(offset) * CHR_TILE_ROWS;
+
+    for (unsigned i = 0; i < 8; i++) {
+        unsigned bit = 7 - i;
+        byte value = ((low >> bit) & 1) | (((high >> bit) & 1) << 1);
+        row[i] = value;
+        flipped[7 - i] = value;
+    }
+}
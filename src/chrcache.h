@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include "armadadef.h"
+
+const unsigned CHR_TILE_SIZE = 16;
+const unsigned CHR_TILE_ROWS = 8;
+
+// Every row of every tile in CHR, with its two bitplanes already combined into 8 pixel values
+// of 0-3, plus the same row mirrored for horizontally flipped sprites. Rows are found by their
+// offset into CHR, so the cache stays valid whichever banks a mapper has switched in.
+class ChrCache {
+public:
+    ChrCache();
+    ~ChrCache();
+
+    void build(const byte *chr, uint32_t size);
+
+    // decodes all of CHR again at the same size, after CHR RAM has been replaced wholesale
+    void refresh(const byte *chr);
+
+    // called for CHR that can be written, to keep the row containing offset up to date
+    void update(const byte *chr, uint32_t offset);
+
+    // offset is the tile's offset into CHR plus the row within it, the same as for the low bitplane
+    const byte *getRow(uint32_t offset) const {
+        return rows + getRowIndex(offset) * CHR_TILE_ROWS;
+    }
+
+    const byte *getFlippedRow(uint32_t offset) const {
+        return flippedRows + getRowIndex(offset) * CHR_TILE_ROWS;
+    }
+
+private:
+    static uint32_t getRowIndex(uint32_t offset) {
+        return (offset / CHR_TILE_SIZE) * CHR_TILE_ROWS + (offset & (CHR_TILE_ROWS - 1));
+    }
+
+    void decodeRow(const byte *chr, uint32_t offset);
+
+    byte *rows;
+    byte *flippedRows;
+    uint32_t size;
+};
@@ -3,29 +3,31 @@
 #include "cpu.h"
 #include "system.h"
 #include "cpubus.h"
-
-#define BYTE_TO_BINARY_PATTERN "%c%c%c%c%c%c%c%c"
-#define BYTE_TO_BINARY(byte)  \
-  (byte & 0x80 ? '1' : '0'), \
-  (byte & 0x40 ? '1' : '0'), \
-  (byte & 0x20 ? '1' : '0'), \
-  (byte & 0x10 ? '1' : '0'), \
-  (byte & 0x08 ? '1' : '0'), \
-  (byte & 0x04 ? '1' : '0'), \
-  (byte & 0x02 ? '1' : '0'), \
-  (byte & 0x01 ? '1' : '0')
-
+#include "tracelog.h"
+#include "savestate.h"
 
 Cpu::Cpu(System *system) {
     this->system = system;
+    this->instructionPc = 0;
+    this->operand = 0;
+    this->blocks = new CpuBlock[CPU_BLOCK_CACHE_SIZE]();
+    this->currentBlock = nullptr;
+    this->blockIndex = 0;
+    this->ramCodePages = 0;
     this->cyclesToSkip = 0;
+    this->nmiPending = false;
+    this->irqLines = 0;
+    this->runEnded = false;
     this->totalCycles = 7;
+    this->totalInstructions = 0;
+    this->trace = nullptr;
     setupInstructions();
-    log = fopen("cpu.log", "w");
+    invalidateBlocks(0x0000, 0xFFFF);
 }
 
 Cpu::~Cpu() {
-
+    stopTrace();
+    delete[] blocks;
 }
 
 void Cpu::start() {
@@ -34,7 +36,6 @@ void Cpu::start() {
     registers.x = 0;
     registers.y = 0;
     registers.pc = readAddress(VECTOR_RESET);
-    registers.pc = 0xC000; // for nestest
     registers.s = 0xFD;
 }
 
@@ -45,8 +46,6 @@ void Cpu::reset() {
 }
 
 void Cpu::step() {
-    char logline[512];
-
     // run a cycle
     if (cyclesToSkip > 0) {
         cyclesToSkip--;
@@ -54,32 +53,222 @@ void Cpu::step() {
         return;
     }
 
-    address pc = registers.pc;
-    byte opcode = system->getBus()->read(registers.pc++);
-    CpuInstruction *instruction = &instructions[opcode];
+    executeInstruction();
+}
 
-    if (!instruction->legal) {
-        snprintf(logline, sizeof(logline), "%04X Illegal instruction %02X\n", pc, opcode);
-        fwrite(logline, sizeof(char), strlen(logline), log); fflush(log);
-        printf("Illegal instruction %02x\n", opcode);
+// Runs the given number of cycles, with the same result as calling step() that many times, but
+// the cycles spent by an instruction are skipped all at once. An instruction that doesn't fit in
+// the budget is still started, and the rest of its cycles are skipped by the next call.
+void Cpu::run(unsigned cycles) {
+    unsigned remaining = cycles;
+    runEnded = false;
+
+    while (remaining > 0 && !runEnded) {
+        if (cyclesToSkip > 0) {
+            unsigned skip = cyclesToSkip < remaining ? cyclesToSkip : remaining;
+            cyclesToSkip -= skip;
+            totalCycles += skip;
+            remaining -= skip;
+            continue;
+        }
+
+        executeInstruction();
+        remaining--;
     }
+}
 
-    if (instruction->addressingMode != nullptr && instruction->operation != nullptr) {
-        address addr = (this->*instruction->addressingMode)(instruction);
+void Cpu::executeInstruction() {
+    // an NMI raised while the previous instruction ran is taken before the next one starts
+    if (nmiPending) {
+        nmiPending = false;
+        enterInterrupt(VECTOR_NMI);
+        return;
+    }
+
+    if (irqLines != 0 && !(registers.p & CpuStatusFlag_InterruptDisable)) {
+        enterInterrupt(VECTOR_IRQ);
+        return;
+    }
+
+    const CpuDecodedInstruction *decoded = fetchInstruction();
+    CpuInstruction *instruction = &instructions[decoded->opcode];
 
-        snprintf(logline, sizeof(logline), "%04X %02X (%s %s with %04X = %02X) cycle: %u, A: %02X, X: %02X, Y: %02X, S: %02X, P: " BYTE_TO_BINARY_PATTERN " %02X\n",
-                 pc, opcode, instruction->operationName, instruction->addressingModeName, addr, system->getBus()->read(addr), totalCycles, registers.a, registers.x, registers.y, registers.s, BYTE_TO_BINARY(registers.p), registers.p);
-        fwrite(logline, sizeof(char), strlen(logline), log); fflush(log);
+    instructionPc = decoded->pc;
+    operand = decoded->operand;
+    registers.pc = decoded->pc + 1 + instruction->operandLength;
 
-        (this->*instruction->operation)(instruction, addr);
+    if (!instruction->legal) {
+        if (trace != nullptr) {
+            traceInstruction(instruction, ZERO_ADDRESS, TraceRecordFlag_Illegal);
+        }
+        printf("Illegal instruction %02x\n", decoded->opcode);
+    }
+
+    if (instruction->execute != nullptr) {
+        (this->*instruction->execute)(instruction);
         cyclesToSkip += instruction->cycles - 1;
     }
 
+    totalInstructions++;
     totalCycles++;
 }
 
+// only RAM and PRG hold code that can be decoded ahead of time, everything else may have side effects
+static bool isCacheableRegion(address start, address end) {
+    if (end < start) {
+        return false;
+    }
+
+    return end < 0x2000 || start >= 0x8000;
+}
+
+static unsigned getBlockSlot(address pc) {
+    return (pc ^ (pc >> 8)) & (CPU_BLOCK_CACHE_SIZE - 1);
+}
+
+const CpuDecodedInstruction *Cpu::fetchInstruction() {
+    address pc = registers.pc;
+
+    // carrying on through the current block is the common case
+    if (currentBlock != nullptr && blockIndex < currentBlock->count && currentBlock->instructions[blockIndex].pc == pc) {
+        return &currentBlock->instructions[blockIndex++];
+    }
+
+    CpuBlock *block = &blocks[getBlockSlot(pc)];
+    if (!block->valid || block->start != pc) {
+        block = decodeBlock(pc);
+    }
+
+    if (block == nullptr) {
+        currentBlock = nullptr;
+        decodeInstruction(pc, &uncachedInstruction);
+        return &uncachedInstruction;
+    }
+
+    currentBlock = block;
+    blockIndex = 1;
+    return &block->instructions[0];
+}
+
+CpuBlock *Cpu::decodeBlock(address pc) {
+    CpuBlock *block = &blocks[getBlockSlot(pc)];
+    block->valid = false;
+    block->start = pc;
+    block->end = pc;
+    block->count = 0;
+
+    while (block->count < CPU_BLOCK_MAX_INSTRUCTIONS) {
+        CpuInstruction *instruction = &instructions[system->getBus()->read(pc)];
+        address end = pc + instruction->operandLength;
+        if (!isCacheableRegion(block->start, end)) {
+            break;
+        }
+
+        decodeInstruction(pc, &block->instructions[block->count++]);
+        block->end = end;
+        pc = end + 1;
+
+        if (instruction->endsBlock || pc == 0x0000) {
+            break;
+        }
+    }
+
+    if (block->count == 0) {
+        return nullptr;
+    }
+
+    block->valid = true;
+
+    if (block->end < 0x2000) {
+        ramCodePages |= 1U << ((block->start & 0x7FF) >> 8);
+        ramCodePages |= 1U << ((block->end & 0x7FF) >> 8);
+    }
+
+    return block;
+}
+
+void Cpu::decodeInstruction(address pc, CpuDecodedInstruction *decoded) {
+    CpuBus *bus = system->getBus();
+
+    decoded->pc = pc;
+    decoded->opcode = bus->read(pc);
+    decoded->operand = 0;
+
+    switch (instructions[decoded->opcode].operandLength) {
+        case 2: {
+            decoded->operand = readAddress(pc + 1);
+            break;
+        }
+
+        case 1: {
+            decoded->operand = bus->read(pc + 1);
+            break;
+        }
+    }
+}
+
+void Cpu::invalidateBlocks(address start, address end) {
+    ramCodePages = 0;
+
+    for (unsigned i = 0; i < CPU_BLOCK_CACHE_SIZE; i++) {
+        CpuBlock *block = &blocks[i];
+        if (!block->valid) {
+            continue;
+        }
+
+        if (block->start <= end && block->end >= start) {
+            block->valid = false;
+        } else if (block->end < 0x2000) {
+            ramCodePages |= 1U << ((block->start & 0x7FF) >> 8);
+            ramCodePages |= 1U << ((block->end & 0x7FF) >> 8);
+        }
+    }
+
+    currentBlock = nullptr;
+}
+
+void Cpu::traceInstruction(CpuInstruction *instruction, address addr, byte flags) {
+    // reading a register here would sync the PPU, clear vblank, step $2007 and so on,
+    // so tracing would change what the program sees
+    if (addr >= 0x2000 && addr <= 0x401F) {
+        flags |= TraceRecordFlag_NoOperandValue;
+    }
+
+    TraceRecord record;
+    record.cycle = totalCycles;
+    record.pc = instructionPc;
+    record.operandAddress = addr;
+    record.opcode = instruction->opcode;
+    record.operandValue = (flags & (TraceRecordFlag_Illegal | TraceRecordFlag_NoOperandValue)) ? 0 : system->getBus()->read(addr);
+    record.a = registers.a;
+    record.x = registers.x;
+    record.y = registers.y;
+    record.s = registers.s;
+    record.p = registers.p;
+    record.flags = flags;
+
+    trace->push(record);
+}
+
+bool Cpu::startTrace(const char *path) {
+    stopTrace();
+
+    trace = new TraceLog;
+    if (!trace->open(path, instructions)) {
+        stopTrace();
+        return false;
+    }
+
+    return true;
+}
+
+void Cpu::stopTrace() {
+    delete trace;
+    trace = nullptr;
+}
+
 void Cpu::pushStack(byte val) {
-    system->getBus()->write(0x0100 + registers.s, val);
+    write(0x0100 + registers.s, val);
     if (registers.s == 0x00) registers.s = 0xFF;
     else registers.s--;
 }
@@ -94,21 +283,56 @@ address Cpu::readAddress(address ptr) {
     return system->getBus()->read(ptr) | (system->getBus()->read(ptr + 1) << 8);
 }
 
-void Cpu::generateIrq() {
-    if (!(registers.p & CpuStatusFlag_InterruptDisable)) {
-        if (registers.p & CpuStatusFlag_Break) {
-            registers.p &= ~CpuStatusFlag_Break;
-        }
+bool Cpu::write(address ptr, byte value) {
+    // RAM is mirrored, so any write to a page with decoded code in it drops every block in RAM
+    if (ptr < 0x2000 && (ramCodePages & (1U << ((ptr & 0x7FF) >> 8)))) {
+        invalidateBlocks(0x0000, 0x1FFF);
+    }
 
-        pushStack((registers.pc >> 8) & 0xFF);
-        pushStack(registers.pc & 0xFF);
-        pushStack(registers.p);
-        registers.p |= CpuStatusFlag_InterruptDisable;
-        registers.pc = readAddress(VECTOR_IRQ);
+    return system->getBus()->write(ptr, value);
+}
+
+void Cpu::saveState(CpuState *state) const {
+    state->registers = registers;
+    state->cyclesToSkip = cyclesToSkip;
+    state->totalCycles = totalCycles;
+    state->totalInstructions = totalInstructions;
+    state->nmiPending = nmiPending;
+    state->irqLines = irqLines;
+    memset(state->padding, 0, sizeof(state->padding));
+}
+
+// the caller is expected to invalidate blocks once memory has been restored as well
+void Cpu::loadState(const CpuState *state) {
+    registers = state->registers;
+    cyclesToSkip = state->cyclesToSkip;
+    totalCycles = state->totalCycles;
+    totalInstructions = state->totalInstructions;
+    nmiPending = state->nmiPending != 0;
+    irqLines = state->irqLines;
+    currentBlock = nullptr;
+}
+
+void Cpu::setIrqLine(unsigned source, bool asserted) {
+    if (asserted) {
+        irqLines |= source;
+    } else {
+        irqLines &= ~source;
     }
 }
 
+// The PPU may raise an NMI from inside a register access, partway through an instruction that
+// hasn't finished with PC yet, so it's only latched here
 void Cpu::generateNmi() {
+    nmiPending = true;
+}
+
+void Cpu::stall(unsigned cycles) {
+    cyclesToSkip += cycles;
+}
+
+// takes the place of an instruction, 7 cycles long
+void Cpu::enterInterrupt(address vector) {
     if (registers.p & CpuStatusFlag_Break) {
         registers.p &= ~CpuStatusFlag_Break;
     }
@@ -117,5 +341,7 @@ void Cpu::generateNmi() {
     pushStack(registers.pc & 0xFF);
     pushStack(registers.p);
     registers.p |= CpuStatusFlag_InterruptDisable;
-    registers.pc = readAddress(VECTOR_NMI);
+    registers.pc = readAddress(vector);
+    cyclesToSkip += 6;
+    totalCycles++;
 }
\ No newline at end of file
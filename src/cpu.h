@@ -1,10 +1,16 @@
 #pragma once
-#include <cstdio>
 #include "armadadef.h"
 #include "cpudefs.h"
 
 class System;
 class CpuBus;
+class TraceLog;
+struct CpuState;
+
+// everything that can hold the IRQ line low, the CPU sees an IRQ while any of them do
+enum {
+    CpuIrqSource_Mapper                         = 1 << 0,
+};
 
 class Cpu {
 public:
@@ -14,29 +20,75 @@ public:
     void start();
     void reset();
     void step();
+    void run(unsigned cycles);
 
     void pushStack(byte val);
     byte popStack();
 
     address readAddress(address ptr);
+    bool write(address ptr, byte value);
+
+    // drops decoded code overlapping the given range, e.g. after a mapper switches PRG banks
+    void invalidateBlocks(address start, address end);
 
-    void generateIrq();
+    void saveState(CpuState *state) const;
+    void loadState(const CpuState *state);
+
+    // level triggered, so the IRQ is taken again after RTI unless the source is acknowledged
+    void setIrqLine(unsigned source, bool asserted);
     void generateNmi();
 
+    // makes run() return after the current instruction, when something has moved the deadline it was given
+    void endRun() { this->runEnded = true; }
+
+    // holds the CPU for the given number of cycles once the current instruction is done, as during OAM DMA
+    void stall(unsigned cycles);
+
+    unsigned getTotalCycles() const { return this->totalCycles; }
+    uint64_t getTotalInstructions() const { return this->totalInstructions; }
+
+    // tracing is off unless started, and costs a single branch per instruction while off
+    bool startTrace(const char *path);
+    void stopTrace();
+    bool isTracing() const { return this->trace != nullptr; }
+
     CpuRegisters registers;
 
 private:
     void setupInstructions();
+    void executeInstruction();
+    void enterInterrupt(address vector);
+    const CpuDecodedInstruction *fetchInstruction();
+    CpuBlock *decodeBlock(address pc);
+    void decodeInstruction(address pc, CpuDecodedInstruction *decoded);
+    void traceInstruction(CpuInstruction *instruction, address addr, byte flags = 0);
+
+    template <AddressingCallback addressingMode, OpCallback operation>
+    void execute(CpuInstruction *instruction);
 
     System *system;
-    CpuInstruction instructions[0xFF];
+    CpuInstruction instructions[0x100];
+    address instructionPc;
+    address operand;
+
+    CpuBlock *blocks;
+    CpuBlock *currentBlock;
+    unsigned blockIndex;
+    CpuDecodedInstruction uncachedInstruction;
+    byte ramCodePages;  // one bit per 256 bytes of RAM that has decoded code in it
     unsigned cyclesToSkip;
+    bool nmiPending;
+    byte irqLines;
+    bool runEnded;
     unsigned totalCycles;
+    uint64_t totalInstructions;
 
-    FILE *log;
+    TraceLog *trace;
 
+// pageCrossPenalty is fixed per opcode, and decides whether indexed modes
+// spend an extra cycle when the index crosses a page
 #define DECLARE_ADDRESS_MODE(mnemonic) \
-    address addr##mnemonic(CpuInstruction *)
+    template <bool pageCrossPenalty> address addr##mnemonic(CpuInstruction *)
 
     DECLARE_ADDRESS_MODE(Acc); // accumulator
     DECLARE_ADDRESS_MODE(Imm); // immediate
@@ -4,33 +4,122 @@
 #include "cpubus.h"
 #include "system.h"
 #include "mapper.h"
+#include "ppu.h"
+#include "cpu.h"
+#include "savestate.h"
 
 const byte SPECIAL_UNMAPPED = 0xAF;
 const byte SPECIAL_UNKNOWN_MAP_TYPE = 0xFA;
 
 static byte readCartridgePrgRomCallback(address addr, void *userData);
-static bool writeReadOnlyCallback(address addr, byte value, void *userData);
+static bool writeMapperCallback(address addr, byte value, void *userData);
+static byte readPpuRegisterCallback(address addr, void *userData);
+static bool writePpuRegisterCallback(address addr, byte value, void *userData);
+static byte readOamDmaCallback(address addr, void *userData);
+static bool writeOamDmaCallback(address addr, byte value, void *userData);
 
 CpuBus::CpuBus(System *system) : Bus() {
     this->system = system;
-    this->ram = new byte[0x800];
+    this->ppu = nullptr;
+    this->mapper = nullptr;
+    this->ram = new byte[CPU_RAM_SIZE];
+    memset(this->ram, 0, CPU_RAM_SIZE);
 
-    mapMemory(0x0000, 0x1FFF, ram, 0x0800);
+    mapMemory(0x0000, 0x1FFF, ram, CPU_RAM_SIZE);
 }
 
 CpuBus::~CpuBus() {
     delete[] ram;
 }
 
+// only reached for pages the mapper has left without a bank
 byte readCartridgePrgRomCallback(address addr, void *userData) {
-    Mapper *mapper = (Mapper *)userData;
-    return mapper->readPrg(addr);
+    CpuBus *bus = (CpuBus *)userData;
+    return bus->getMapper()->readPrg(addr);
 }
 
-bool writeReadOnlyCallback(address addr, byte value, void *userData) {
-    return false;
+// PRG reads go straight to the banks on the page table, writes go to the mapper's registers
+bool writeMapperCallback(address addr, byte value, void *userData) {
+    CpuBus *bus = (CpuBus *)userData;
+    bus->writeMapper(0x8000 + addr, value);
+    return true;
 }
 
 void CpuBus::setCartridgeMapper(Mapper *mapper) {
-    mapCallback(0x8000, 0xFFFF, readCartridgePrgRomCallback, writeReadOnlyCallback, mapper);
-}
\ No newline at end of file
+    this->mapper = mapper;
+    mapMemory(0x6000, 0x7FFF, mapper->getPrgRam(), PRG_RAM_SIZE);
+    mapBanked(0x8000, 0xFFFF, readCartridgePrgRomCallback, writeMapperCallback, this);
+    for (unsigned i = 0; i < PRG_BANK_COUNT; i++) {
+        setBank(static_cast<address>(0x8000 + i * PRG_BANK_SIZE), PRG_BANK_SIZE, mapper->getPrgBank(i));
+    }
+}
+
+byte readPpuRegisterCallback(address addr, void *userData) {
+    CpuBus *bus = (CpuBus *)userData;
+    return bus->readPpuRegister(addr);
+}
+
+bool writePpuRegisterCallback(address addr, byte value, void *userData) {
+    CpuBus *bus = (CpuBus *)userData;
+    bus->writePpuRegister(addr, value);
+    return true;
+}
+
+// write only, reads see open bus
+byte readOamDmaCallback(address addr, void *userData) {
+    return 0;
+}
+
+bool writeOamDmaCallback(address addr, byte value, void *userData) {
+    CpuBus *bus = (CpuBus *)userData;
+    bus->writeOamDma(value);
+    return true;
+}
+
+// the eight registers repeat all the way up to 0x3FFF
+void CpuBus::setPpu(Ppu *ppu) {
+    this->ppu = ppu;
+    mapCallback(0x2000, 0x3FFF, readPpuRegisterCallback, writePpuRegisterCallback, this);
+    mapCallback(0x4014, 0x4014, readOamDmaCallback, writeOamDmaCallback, this);
+}
+
+// the PPU is only caught up with the CPU when its registers are accessed
+byte CpuBus::readPpuRegister(address addr) {
+    system->syncPpu();
+    return ppu->readRegister(addr);
+}
+
+void CpuBus::writePpuRegister(address addr, byte value) {
+    system->syncPpu();
+    ppu->writeRegister(addr, value);
+
+    // turning rendering on or off moves the next scanline IRQ, so the CPU's deadline is stale
+    if ((addr & 7) == 1) {
+        system->getCpu()->endRun();
+    }
+}
+
+// copies a page into OAM in one go, then holds the CPU for as long as the copy would have taken
+void CpuBus::writeOamDma(byte page) {
+    system->syncPpu();
+
+    byte data[0x100];
+    for (unsigned i = 0; i < sizeof(data); i++) {
+        data[i] = read(static_cast<address>((page << 8) | i));
+    }
+    ppu->writeOamDma(data);
+
+    // one extra cycle to line up with a read cycle when starting on an odd one
+    Cpu *cpu = system->getCpu();
+    cpu->stall(513 + (cpu->getTotalCycles() & 1));
+}
+
+// A bank switch or mirroring change can affect what the PPU draws, and an IRQ register changes
+// when the next IRQ is due, so the PPU is caught up first and the CPU stops after this
+// instruction to work out its deadline again.
+void CpuBus::writeMapper(address addr, byte value) {
+    system->syncPpu();
+    ppu->catchUp();
+    mapper->writeRegister(addr, value);
+    system->getCpu()->endRun();
+}
@@ -4,6 +4,7 @@
 
 class System;
 class Mapper;
+class Ppu;
 
 // represents the address space
 class CpuBus : public Bus {
@@ -12,9 +13,20 @@ public:
     ~CpuBus();
 
     void setCartridgeMapper(Mapper *mapper);
+    void setPpu(Ppu *ppu);
+
+    byte *getRam() const { return this->ram; }
+    Mapper *getMapper() const { return this->mapper; }
+
+    byte readPpuRegister(address addr);
+    void writePpuRegister(address addr, byte value);
+    void writeOamDma(byte page);
+    void writeMapper(address addr, byte value);
 
 private:
     System *system;
+    Ppu *ppu;
+    Mapper *mapper;
 
     byte *ram;
 };
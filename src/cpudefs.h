@@ -26,17 +26,40 @@ enum {
 struct CpuInstruction;
 typedef address (Cpu::*AddressingCallback)(CpuInstruction *instruction);
 typedef void (Cpu::*OpCallback)(CpuInstruction *instruction, address addr);
+// an addressing mode and operation fused together at compile time
+typedef void (Cpu::*InstructionCallback)(CpuInstruction *instruction);
 
 struct CpuInstruction {
     bool legal;
     byte opcode;
-    AddressingCallback addressingMode;
-    OpCallback operation;
+    InstructionCallback execute;
     unsigned cycles;
+    unsigned operandLength;
+    bool endsBlock;
     const char *addressingModeName;
     const char *operationName;
 };
 
+// an instruction as fetched from memory, with its operand bytes combined little-endian
+struct CpuDecodedInstruction {
+    address pc;
+    address operand;
+    byte opcode;
+};
+
+const unsigned CPU_BLOCK_MAX_INSTRUCTIONS = 16;
+const unsigned CPU_BLOCK_CACHE_SIZE = 256;
+
+// A run of straight-line code, decoded once and reused until the memory behind it changes.
+// Blocks end after an instruction that can jump, or before one that would leave the region.
+struct CpuBlock {
+    bool valid;
+    address start;
+    address end;        // last byte of the last instruction
+    unsigned count;
+    CpuDecodedInstruction instructions[CPU_BLOCK_MAX_INSTRUCTIONS];
+};
+
 const address VECTOR_NMI = 0xFFFA;
 const address VECTOR_RESET = 0xFFFC;
 const address VECTOR_IRQ = 0xFFFE;
\ No newline at end of file
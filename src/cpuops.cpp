@@ -6,7 +6,7 @@
 #include "cpubus.h"
 
 #define DEFINE_ADDRESS_MODE(mnemonic) \
-    address Cpu::addr##mnemonic(CpuInstruction *instruction)
+    template <bool pageCrossPenalty> address Cpu::addr##mnemonic(CpuInstruction *instruction)
 
 #define DEFINE_OPERATION(mnemonic) \
     void Cpu::op##mnemonic(CpuInstruction *instruction, address addr)
@@ -14,7 +14,7 @@
 // read a single byte from memory
 #define READ(addr) (this->system->getBus()->read(addr))
 // write a single byte to memory
-#define WRITE(addr, value) (this->system->getBus()->write(addr, value))
+#define WRITE(addr, value) (this->write(addr, value))
 #define R_A (this->registers.a)
 #define R_X (this->registers.x)
 #define R_Y (this->registers.y)
@@ -49,13 +49,53 @@
         SPEND_CYCLES(cycles);                       \
     }
 
+// compare two names at compile time
+static constexpr bool isSameName(const char *a, const char *b) {
+    return *a == *b && (*a == '\0' || isSameName(a + 1, b + 1));
+}
+
+// number of operand bytes that follow the opcode
+static constexpr unsigned operandLength(const char *addressingMode) {
+    return (isSameName(addressingMode, "Acc") || isSameName(addressingMode, "Imp")) ? 0
+        : (addressingMode[0] == 'A' && addressingMode[1] == 'b') ? 2
+        : 1;
+}
+
+// whether the operation can take PC somewhere other than the next instruction
+static constexpr bool isControlFlow(const char *operation) {
+    return (operation[0] == 'B' && !isSameName(operation, "BIT"))
+        || isSameName(operation, "JMP") || isSameName(operation, "JSR")
+        || isSameName(operation, "RTI") || isSameName(operation, "RTS");
+}
+
+// Only reads take the extra cycle when indexing crosses a page. Stores and read-modify-writes
+// always spend it, and their cycle counts already include it.
+static constexpr bool hasPageCrossPenalty(const char *operation) {
+    return !isSameName(operation, "STA")
+        && !isSameName(operation, "ASL") && !isSameName(operation, "LSR")
+        && !isSameName(operation, "ROL") && !isSameName(operation, "ROR")
+        && !isSameName(operation, "INC") && !isSameName(operation, "DEC");
+}
+
+// Every opcode gets its own instantiation of this, so both calls are to known
+// functions and get inlined into a single handler
+template <AddressingCallback addressingMode, OpCallback operation>
+void Cpu::execute(CpuInstruction *instruction) {
+    address addr = (this->*addressingMode)(instruction);
+    if (trace != nullptr) {
+        traceInstruction(instruction, addr);
+    }
+    (this->*operation)(instruction, addr);
+}
+
 void Cpu::setupInstructions() {
     // initially define all opcodes as illegal
-    for (byte i = 0; i < 0xFF; i++) {
+    for (unsigned i = 0; i < 0x100; i++) {
         memset(&instructions[i], 0, sizeof(CpuInstruction));
         instructions[i].legal = false;
         instructions[i].opcode = i;
         instructions[i].cycles = 1;
+        instructions[i].endsBlock = true;
     }
 
 #define DEFINE_INST(_opcode, _addressingMode, _operation, _cycles)              \
@@ -63,9 +103,12 @@ void Cpu::setupInstructions() {
     /* int multiple_decl_##_addressingMode##_##_operation; */                   \
     instructions[(_opcode)].legal = true;                                       \
     instructions[(_opcode)].opcode = (_opcode);                                 \
-    instructions[(_opcode)].addressingMode = &Cpu::addr##_addressingMode;       \
-    instructions[(_opcode)].operation = &Cpu::op##_operation;                   \
+    instructions[(_opcode)].execute = &Cpu::execute<                            \
+        &Cpu::addr##_addressingMode<hasPageCrossPenalty(#_operation)>,          \
+        &Cpu::op##_operation>;                                                  \
     instructions[(_opcode)].cycles = _cycles;                                   \
+    instructions[(_opcode)].operandLength = operandLength(#_addressingMode);    \
+    instructions[(_opcode)].endsBlock = isControlFlow(#_operation);             \
     instructions[(_opcode)].addressingModeName = #_addressingMode;              \
     instructions[(_opcode)].operationName = #_operation;
 
@@ -337,48 +380,47 @@ void Cpu::setupInstructions() {
 #undef DEFINE_INST
 }
 
+// The opcode and operand bytes have already been fetched when these run: PC points past the
+// whole instruction, and the operand bytes are in this->operand
+
 DEFINE_ADDRESS_MODE(Acc) {
     return ZERO_ADDRESS;
 }
 
 DEFINE_ADDRESS_MODE(Imm) {
-    return registers.pc++;
+    return R_PC - 1;
 }
 
 DEFINE_ADDRESS_MODE(Abs) {
-    uint16_t addr = readAddress(R_PC);
-    R_PC += 2;
-    return addr;
+    return operand;
 }
 
 DEFINE_ADDRESS_MODE(Abx) {
-    uint16_t addr = readAddress(R_PC);
-    R_PC += 2;
-    if (strcmp(instruction->operationName, "STA") != 0) {
+    uint16_t addr = operand;
+    if (pageCrossPenalty) {
         SPEND_IF_PAGE_CROSSED(addr, addr + R_X, 1);
     }
     return addr + R_X;
 }
 
 DEFINE_ADDRESS_MODE(Aby) {
-    uint16_t addr = readAddress(R_PC);
-    R_PC += 2;
-    if (strcmp(instruction->operationName, "STA") != 0) {
+    uint16_t addr = operand;
+    if (pageCrossPenalty) {
         SPEND_IF_PAGE_CROSSED(addr, addr + R_Y, 1);
     }
     return addr + R_Y;
 }
 
 DEFINE_ADDRESS_MODE(Zer) {
-    return READ(R_PC++);
+    return operand;
 }
 
 DEFINE_ADDRESS_MODE(Zex) {
-    return (READ(R_PC++) + R_X) & 0xFF;
+    return (operand + R_X) & 0xFF;
 }
 
 DEFINE_ADDRESS_MODE(Zey) {
-    return (READ(R_PC++) + R_Y) & 0xFF;
+    return (operand + R_Y) & 0xFF;
 }
 
 DEFINE_ADDRESS_MODE(Imp) {
@@ -386,7 +428,7 @@ DEFINE_ADDRESS_MODE(Imp) {
 }
 
 DEFINE_ADDRESS_MODE(Rel) {
-    address offset = READ(R_PC++);
+    address offset = operand;
     if (offset & 0x80) {
         offset |= 0xFF00;
     }
@@ -396,24 +438,23 @@ DEFINE_ADDRESS_MODE(Rel) {
 }
 
 DEFINE_ADDRESS_MODE(Inx) {
-    address zeroL = (READ(R_PC++) + R_X) & 0xFF;
+    address zeroL = (operand + R_X) & 0xFF;
     address zeroH = (zeroL + 1) & 0xFF;
     return READ(zeroL) | (READ(zeroH) << 8);
 }
 
 DEFINE_ADDRESS_MODE(Iny) {
-    address zeroL = READ(R_PC++);
+    address zeroL = operand;
     address zeroH = (zeroL + 1) & 0xFF;
     address addr = READ(zeroL) | (READ(zeroH) << 8);
-    if (strcmp(instruction->operationName, "STA") != 0) {
+    if (pageCrossPenalty) {
         SPEND_IF_PAGE_CROSSED(addr, addr + R_Y, 1);
     }
     return addr + R_Y;
 }
 
 DEFINE_ADDRESS_MODE(Abi) {
-    address abs = readAddress(R_PC);
-    R_PC += 2;
+    address abs = operand;
 
     address effL = READ(abs);
 #if 0
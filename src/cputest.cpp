@@ -0,0 +1,135 @@
+// Cycle counts the CPU has to get right whatever handler an opcode ends up with. Run by ctest.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "system.h"
+#include "cpu.h"
+#include "cpubus.h"
+#include "rom.h"
+
+static unsigned failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// where each case's code is put in RAM, past the stack and the zero page pointer
+const address CODE_START = 0x0400;
+
+// an NROM with nothing but NOPs, only there so the System has something to start
+static bool writeNopRom(const char *path) {
+    std::vector<byte> image(sizeof(InesHeader) + 0x4000 + 0x2000, 0);
+    memcpy(image.data(), "NES\x1A\x01\x01", 6);
+    memset(image.data() + sizeof(InesHeader), 0xEA, 0x4000);
+    image[sizeof(InesHeader) + (VECTOR_RESET & 0x3FFF)] = 0x00;
+    image[sizeof(InesHeader) + (VECTOR_RESET & 0x3FFF) + 1] = 0x80;
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(image.data(), 1, image.size(), f) == image.size();
+    return fclose(f) == 0 && ok;
+}
+
+struct CycleCase {
+    const char *name;
+    byte code[3];
+    unsigned cycles;
+};
+
+// X and Y are 1 and ($10) points at $02FF, so indexing from $02FF crosses into $0300
+static const CycleCase cycleCases[] = {
+    { "LDA abs,X", { 0xBD, 0x00, 0x02 }, 4 },
+    { "LDA abs,X across a page", { 0xBD, 0xFF, 0x02 }, 5 },
+    { "LDA abs,Y across a page", { 0xB9, 0xFF, 0x02 }, 5 },
+    { "LDA (zp),Y across a page", { 0xB1, 0x10 }, 6 },
+    { "STA abs,X across a page", { 0x9D, 0xFF, 0x02 }, 5 },
+    { "STA abs,Y across a page", { 0x99, 0xFF, 0x02 }, 5 },
+    { "STA (zp),Y across a page", { 0x91, 0x10 }, 6 },
+    { "INC abs,X", { 0xFE, 0x00, 0x02 }, 7 },
+    { "INC abs,X across a page", { 0xFE, 0xFF, 0x02 }, 7 },
+    { "DEC abs,X across a page", { 0xDE, 0xFF, 0x02 }, 7 },
+    { "ASL abs,X across a page", { 0x1E, 0xFF, 0x02 }, 7 },
+    { "LSR abs,X across a page", { 0x5E, 0xFF, 0x02 }, 7 },
+    { "ROL abs,X across a page", { 0x3E, 0xFF, 0x02 }, 7 },
+    { "ROR abs,X across a page", { 0x7E, 0xFF, 0x02 }, 7 },
+};
+
+// Runs the code from RAM a cycle at a time, and returns how many cycles went by before the NOP
+// after it started.
+static unsigned getCycles(System *system, const byte *code) {
+    byte *ram = system->getBus()->getRam();
+    memcpy(ram + CODE_START, code, 3);
+    memset(ram + CODE_START + 3, 0xEA, 4);
+    ram[0x10] = 0xFF;
+    ram[0x11] = 0x02;
+
+    Cpu *cpu = system->getCpu();
+    cpu->invalidateBlocks(0x0000, 0x07FF);
+    cpu->registers.pc = CODE_START;
+    cpu->registers.x = 1;
+    cpu->registers.y = 1;
+
+    // the cycles still owed by the instruction before are skipped first
+    uint64_t instructions = cpu->getTotalInstructions();
+    unsigned start = 0;
+    while (cpu->getTotalInstructions() == instructions) {
+        start = cpu->getTotalCycles();
+        cpu->step();
+    }
+
+    unsigned end = start;
+    while (cpu->getTotalInstructions() == instructions + 1) {
+        end = cpu->getTotalCycles();
+        cpu->step();
+    }
+    return end - start;
+}
+
+static void testPageCrossing(System *system) {
+    for (const CycleCase &cycleCase : cycleCases) {
+        unsigned cycles = getCycles(system, cycleCase.code);
+        char what[64];
+        snprintf(what, sizeof(what), "%s takes %u cycles, not %u", cycleCase.name, cycleCase.cycles, cycles);
+        check(cycles == cycleCase.cycles, what);
+    }
+
+    // and the read-modify-write still lands on the other page
+    byte *ram = system->getBus()->getRam();
+    ram[0x0300] = 0x41;
+    static const byte inc[] = { 0xFE, 0xFF, 0x02 };
+    getCycles(system, inc);
+    check(ram[0x0300] == 0x42, "INC abs,X across a page writes the next page");
+}
+
+int main() {
+    const char *path = "armadanes-cputest.nes";
+    if (!writeNopRom(path)) {
+        printf("FAIL: can't write %s\n", path);
+        return 1;
+    }
+
+    System system;
+    const char *error = system.loadRom(path);
+    if (error) {
+        printf("FAIL: %s doesn't load: %s\n", path, error);
+        remove(path);
+        return 1;
+    }
+    system.start();
+
+    testPageCrossing(&system);
+    remove(path);
+
+    if (failures != 0) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -10,6 +10,9 @@ D3D9Renderer::D3D9Renderer(App *app) {
     this->app = app;
     this->d3d9 = nullptr;
     this->device = nullptr;
+    this->surface = nullptr;
+    this->surfaceWidth = 0;
+    this->surfaceHeight = 0;
 }
 
 D3D9Renderer::~D3D9Renderer() {
@@ -41,7 +44,8 @@ bool D3D9Renderer::init() {
     pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
     pp.hDeviceWindow = app->getHwnd();
     pp.Windowed = true;
-    pp.PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+    // waits for vertical sync, which paces the presenting loop to the display
+    pp.PresentationInterval = D3DPRESENT_INTERVAL_ONE;
     pp.FullScreen_RefreshRateInHz = D3DPRESENT_RATE_DEFAULT;
 
     hresult = d3d9->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, app->getHwnd(), D3DCREATE_HARDWARE_VERTEXPROCESSING, &pp, &device);
@@ -53,14 +57,94 @@ bool D3D9Renderer::init() {
 }
 
 void D3D9Renderer::shutdown() {
-    SAFE_RELEASE(device);
-    SAFE_RELEASE(d3d9);
+    if (surface) {
+        SAFE_RELEASE(surface);
+    }
+    if (device) {
+        SAFE_RELEASE(device);
+    }
+    if (d3d9) {
+        SAFE_RELEASE(d3d9);
+    }
+}
+
+// copies the frame into an offscreen surface, which StretchRect can then scale into the back buffer.
+// The surface keeps the last frame, so only the rows that changed are copied in.
+bool D3D9Renderer::upload(const VideoFrame &frame) {
+    bool everything = frame.rgbaHeight != PPU_HEIGHT;
+
+    if (!surface || surfaceWidth != frame.rgbaWidth || surfaceHeight != frame.rgbaHeight) {
+        if (surface) {
+            SAFE_RELEASE(surface);
+        }
+
+        HRESULT hresult = device->CreateOffscreenPlainSurface(frame.rgbaWidth, frame.rgbaHeight, D3DFMT_X8R8G8B8, D3DPOOL_DEFAULT, &surface, nullptr);
+        if (hresult != D3D_OK) {
+            surface = nullptr;
+            return false;
+        }
+
+        surfaceWidth = frame.rgbaWidth;
+        surfaceHeight = frame.rgbaHeight;
+        everything = true;
+    }
+
+    unsigned first = 0;
+    unsigned last = frame.rgbaHeight;
+    if (!everything) {
+        if (frame.dirtyRowCount == 0) {
+            return true;
+        }
+        while (!frame.isRowDirty(first)) {
+            first++;
+        }
+        while (!frame.isRowDirty(last - 1)) {
+            last--;
+        }
+    }
+
+    RECT rect = { 0, static_cast<LONG>(first), static_cast<LONG>(frame.rgbaWidth), static_cast<LONG>(last) };
+    D3DLOCKED_RECT locked;
+    if (surface->LockRect(&locked, &rect, 0) != D3D_OK) {
+        return false;
+    }
+
+    // X8R8G8B8 is B, G, R, X in memory, so red and blue swap places
+    for (unsigned y = first; y < last; y++) {
+        if (!everything && !frame.isRowDirty(y)) {
+            continue;
+        }
+
+        const uint32_t *in = frame.rgba + y * frame.rgbaWidth;
+        uint32_t *out = (uint32_t *)((byte *)locked.pBits + (y - first) * locked.Pitch);
+        for (unsigned x = 0; x < frame.rgbaWidth; x++) {
+            uint32_t pixel = in[x];
+            out[x] = (pixel & 0xFF00FF00U) | ((pixel >> 16) & 0xFF) | ((pixel & 0xFF) << 16);
+        }
+    }
+
+    surface->UnlockRect();
+    return true;
 }
 
-void D3D9Renderer::render() {
-    device->Clear(0, nullptr, D3DCLEAR_TARGET, 0xFFFF0000, 1.0f, 0);
-    device->BeginScene();
+void D3D9Renderer::present(const VideoFrame &frame) {
+    if (!device) {
+        return;
+    }
+
+    // there's no geometry, so no scene either, the frame is only copied into the back buffer
+    device->Clear(0, nullptr, D3DCLEAR_TARGET, 0xFF000000, 1.0f, 0);
+
+    if (upload(frame)) {
+        LPDIRECT3DSURFACE9 backBuffer = nullptr;
+        if (device->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &backBuffer) == D3D_OK) {
+            device->StretchRect(surface, nullptr, backBuffer, nullptr, D3DTEXF_POINT);
+            SAFE_RELEASE(backBuffer);
+        }
+    } else {
+        // the surface may be missing rows now, so the next frame is copied in whole
+        invalidate();
+    }
 
-    device->EndScene();
     device->Present(nullptr, nullptr, nullptr, nullptr);
-}
\ No newline at end of file
+}
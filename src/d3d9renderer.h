@@ -1,23 +1,30 @@
 #pragma once
 #include <d3d9.h>
+#include "videosink.h"
 
 class App;
 
-class D3D9Renderer {
+// Presents frames into the window, scaled to fit, waiting for vertical sync
+class D3D9Renderer : public VideoSink {
 public:
     D3D9Renderer(App *app);
     ~D3D9Renderer();
 
-    bool init();
-    void shutdown();
+    bool init() override;
+    void shutdown() override;
 
-    void render();
+protected:
+    bool wantsRgba() const override { return true; }
+    void present(const VideoFrame &frame) override;
 
 private:
+    bool upload(const VideoFrame &frame);
+
     App *app;
 
     LPDIRECT3D9 d3d9;
     LPDIRECT3DDEVICE9 device;
+    LPDIRECT3DSURFACE9 surface;
+    unsigned surfaceWidth;
+    unsigned surfaceHeight;
 };
-
-
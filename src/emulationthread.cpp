@@ -0,0 +1,71 @@
+#include <cstring>
+#include <chrono>
+#include "emulationthread.h"
+#include "framequeue.h"
+#include "system.h"
+#include "ppu.h"
+
+EmulationThread::EmulationThread(System *system, FrameQueue *queue) : running(false), framesRun(0) {
+    this->system = system;
+    this->queue = queue;
+    this->framesPerSecond = 0;
+    this->frameLimit = 0;
+}
+
+EmulationThread::~EmulationThread() {
+    stop();
+}
+
+void EmulationThread::start(double framesPerSecond, unsigned long frames) {
+    stop();
+
+    this->framesPerSecond = framesPerSecond;
+    this->frameLimit = frames;
+    framesRun = 0;
+    running = true;
+    thread = std::thread(&EmulationThread::run, this);
+}
+
+void EmulationThread::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void EmulationThread::run() {
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration period = Clock::duration::zero();
+    if (framesPerSecond > 0) {
+        period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+    }
+    Clock::time_point next = Clock::now();
+
+    while (running.load(std::memory_order_relaxed)) {
+        system->runFrame();
+
+        Frame *frame = queue->getBackBuffer();
+        memcpy(frame->pixels, system->getPpu()->getFramebuffer(), sizeof(frame->pixels));
+        memcpy(frame->rowHashes, system->getPpu()->getRowHashes(), sizeof(frame->rowHashes));
+        frame->number = system->getFrameCount();
+        queue->publish();
+
+        unsigned long ran = framesRun.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (frameLimit != 0 && ran >= frameLimit) {
+            break;
+        }
+
+        if (period != Clock::duration::zero()) {
+            // after falling more than a frame behind, carry on from now rather than rushing to catch up
+            next += period;
+            Clock::time_point now = Clock::now();
+            if (now > next + period) {
+                next = now;
+            }
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    running.store(false, std::memory_order_release);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+#include <thread>
+
+class System;
+class FrameQueue;
+
+// Runs a System on its own thread, publishing every frame to a FrameQueue. Anything else that
+// touches the System, like a reset or starting a trace, has to stop the thread first.
+class EmulationThread {
+public:
+    EmulationThread(System *system, FrameQueue *queue);
+    ~EmulationThread();
+
+    // framesPerSecond paces the frames to real time, 0 runs them as fast as possible;
+    // frames stops the thread after that many, 0 runs until stop()
+    void start(double framesPerSecond, unsigned long frames = 0);
+    void stop();
+
+    // false once stopped, or once the requested number of frames have run
+    bool isRunning() const { return this->running.load(std::memory_order_acquire); }
+    unsigned long getFramesRun() const { return this->framesRun.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+
+    System *system;
+    FrameQueue *queue;
+
+    double framesPerSecond;
+    unsigned long frameLimit;
+
+    std::atomic<bool> running;
+    std::atomic<unsigned long> framesRun;
+    std::thread thread;
+};
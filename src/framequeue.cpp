@@ -0,0 +1,40 @@
+#include <cstring>
+#include <chrono>
+#include "framequeue.h"
+
+FrameQueue::FrameQueue() : middle(1), dropped(0) {
+    this->frames = new Frame[BUFFER_COUNT];
+    memset(this->frames, 0, BUFFER_COUNT * sizeof(Frame));
+    this->front = 0;
+    this->back = 2;
+}
+
+FrameQueue::~FrameQueue() {
+    delete[] frames;
+}
+
+void FrameQueue::publish() {
+    frames[back].timestamp = now();
+
+    // the release makes the pixels visible to whoever swaps the buffer out of the middle
+    unsigned previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    if (previous & FRESH) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    back = previous & INDEX_MASK;
+}
+
+bool FrameQueue::acquire() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+        return false;
+    }
+
+    unsigned previous = middle.exchange(front, std::memory_order_acq_rel);
+    front = previous & INDEX_MASK;
+    return true;
+}
+
+uint64_t FrameQueue::now() {
+    auto time = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+}
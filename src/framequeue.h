@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include "armadadef.h"
+#include "ppu.h"
+
+struct Frame {
+    uint16_t pixels[PPU_WIDTH * PPU_HEIGHT];
+    uint64_t rowHashes[PPU_HEIGHT];
+    unsigned number;        // PPU frame count once the frame was complete
+    uint64_t timestamp;     // steady clock nanoseconds, when it was published
+};
+
+// Triple buffer handing finished frames from the emulation thread to the presenter. The producer
+// always has a buffer to draw into and the consumer always has the newest complete frame, so
+// neither side ever waits; frames the presenter was too slow to pick up are dropped.
+class FrameQueue {
+public:
+    FrameQueue();
+    ~FrameQueue();
+
+    // producer side: draw into the back buffer, then publish it
+    Frame *getBackBuffer() { return &this->frames[this->back]; }
+    void publish();
+
+    // consumer side: swaps in the newest published frame, false if there's been none since the last call
+    bool acquire();
+    const Frame *getFrontBuffer() const { return &this->frames[this->front]; }
+
+    // frames published over the top of one the consumer never acquired
+    unsigned getDroppedCount() const { return this->dropped.load(std::memory_order_relaxed); }
+
+    static uint64_t now();
+
+private:
+    static const unsigned BUFFER_COUNT = 3;
+    static const unsigned FRESH = 0x4;      // set alongside the index while the middle buffer is unread
+    static const unsigned INDEX_MASK = 0x3;
+
+    Frame *frames;
+    unsigned back;                  // only touched by the producer
+    unsigned front;                 // only touched by the consumer
+    std::atomic<unsigned> middle;
+    std::atomic<unsigned> dropped;
+};
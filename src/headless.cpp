@@ -0,0 +1,460 @@
+// Runs a ROM with no frontend and reports how fast the core emulates it
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "system.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "savestate.h"
+#include "rewind.h"
+#include "batch.h"
+#include "framequeue.h"
+#include "emulationthread.h"
+#include "videosink.h"
+#include "headlessvideosink.h"
+#include "ntscfilter.h"
+#include "scalefilter.h"
+#include "rom.h"
+#include "romdatabase.h"
+#include "romscanner.h"
+
+// nestest.rom runs every test unattended from here, without a PPU to show results on
+const address NESTEST_AUTOMATION_START = 0xC000;
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--frames N | --cycles N] [--trace path] [--nestest] [--bench-states N] [--rewind MiB] [video] <rom>\n", program);
+    fprintf(stderr, "       %s --batch N [--frames N] [--threads N] [--pin] <rom>\n", program);
+    fprintf(stderr, "       %s --threaded [--frames N] [--present-hz N] [--unthrottled] [video] <rom>\n", program);
+    fprintf(stderr, "       %s --scan <dir> --db <path> [--threads N]\n", program);
+    fprintf(stderr, "video: --null-video | [--ppm pattern] [--crc path], the pattern gets the frame number, e.g. frame%%05u.ppm\n");
+    fprintf(stderr, "       [--ntsc 2|3 | --scale scale2x|scale3x|xbr2x] [--filter-threads N] runs frames through a filter first\n");
+    fprintf(stderr, "--db <path> corrects ROM headers from a database written by --scan\n");
+    fprintf(stderr, "--nestest starts at $C000, nestest's automated mode, instead of the reset vector\n");
+}
+
+// times taking and restoring snapshots of wherever the run left off
+static void benchStates(System *system, unsigned long iterations) {
+    SystemState *states = new SystemState[2];
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++) {
+        system->saveState(&states[i & 1]);
+    }
+    auto saved = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++) {
+        system->loadState(&states[i & 1]);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double saveNs = std::chrono::duration<double, std::nano>(saved - start).count() / iterations;
+    double loadNs = std::chrono::duration<double, std::nano>(end - saved).count() / iterations;
+
+    printf("state size: %u bytes\n", static_cast<unsigned>(sizeof(SystemState)));
+    printf("save state: %.1f ns\n", saveNs);
+    printf("load state: %.1f ns\n", loadNs);
+
+    delete[] states;
+}
+
+static int runBatch(const char *romPath, unsigned long instances, unsigned long frames, unsigned long threads, bool pinThreads) {
+    BatchOptions options;
+    options.instances = static_cast<unsigned>(instances);
+    options.frames = static_cast<unsigned>(frames);
+    options.threads = static_cast<unsigned>(threads);
+    options.framesPerTask = 60;
+    options.pinThreads = pinThreads;
+    options.frameCallback = nullptr;
+    options.userData = nullptr;
+
+    // instances load quietly, and only the first failure is reported
+    BatchRunner runner(options);
+    bool loaded = runner.run(romPath);
+    const BatchResult *results = runner.getResults();
+    if (!loaded) {
+        const char *error = "not loaded";
+        for (unsigned i = 0; i < options.instances; i++) {
+            if (results[i].error) {
+                error = results[i].error;
+                break;
+            }
+        }
+        fprintf(stderr, "Failed to load ROM %s: %s\n", romPath, error);
+        return 1;
+    }
+
+    // every instance gets the same input, so they should all agree
+    unsigned mismatched = 0;
+    for (unsigned i = 1; i < options.instances; i++) {
+        if (results[i].ramHash != results[0].ramHash) {
+            mismatched++;
+        }
+    }
+
+    double seconds = runner.getSeconds();
+    double ranFrames = static_cast<double>(runner.getTotalFrames());
+
+    printf("Ran %u instances for %u frames on %u threads in %.3f s\n", options.instances, options.frames, runner.getThreadCount(), seconds);
+    printf("RAM hash: %016llx (%u instances differ)\n", static_cast<unsigned long long>(results[0].ramHash), mismatched);
+    printf("frames/sec: %.2f\n", ranFrames / seconds);
+    printf("frames/sec per thread: %.2f\n", ranFrames / seconds / runner.getThreadCount());
+
+    return 0;
+}
+
+// adds every ROM under the directory to the database, only reading files that are new or changed
+static int runScan(const char *directory, const char *databasePath, unsigned long threads) {
+    RomDatabase database;
+    if (!database.load(databasePath)) {
+        fprintf(stderr, "%s is not a ROM database\n", databasePath);
+        return 1;
+    }
+
+    RomScanner scanner(&database, static_cast<unsigned>(threads));
+    scanner.scan(directory);
+
+    if (!database.save(databasePath)) {
+        fprintf(stderr, "Failed to write %s\n", databasePath);
+        return 1;
+    }
+
+    double seconds = scanner.getSeconds();
+    printf("Scanned %u files on %u threads in %.3f s\n", scanner.getFileCount(), scanner.getThreadCount(), seconds);
+    printf("hashed: %u (%.1f MiB), reused: %u, failed: %u\n", scanner.getHashedCount(),
+        scanner.getHashedBytes() / (1024.0 * 1024.0), scanner.getReusedCount(), scanner.getFailedCount());
+    printf("files/sec: %.0f\n", seconds > 0 ? scanner.getFileCount() / seconds : 0.0);
+    printf("database: %zu games, %zu files\n", database.getGameCount(), database.getFileCount());
+
+    return 0;
+}
+
+// false when the headless sink couldn't write some of its output
+static bool finishVideo(VideoSink *video, HeadlessVideoSink *headlessVideo) {
+    if (headlessVideo != nullptr) {
+        printf("video: %u frames, last CRC %08x\n", headlessVideo->getFrameCount(), headlessVideo->getLastCrc());
+    }
+
+    if (video != nullptr && video->getSubmittedCount() > 0) {
+        printf("video: %.1f dirty rows/frame\n", static_cast<double>(video->getDirtyRowTotal()) / video->getSubmittedCount());
+    }
+
+    bool ok = true;
+    if (video != nullptr) {
+        VideoFilter *filter = video->getFilter();
+        video->shutdown();
+        ok = headlessVideo == nullptr || !headlessVideo->hasFailed();
+        delete video;
+        delete filter;
+    }
+    return ok;
+}
+
+static double getPercentile(const std::vector<double> &sorted, double percentile) {
+    size_t index = static_cast<size_t>(percentile / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+// Runs the emulation thread the way the frontend does, with this thread standing in for the
+// presenter, and reports how long frames wait between being finished and being picked up
+static void runThreaded(System *system, unsigned long frames, double presentHz, bool throttled, VideoSink *video) {
+    typedef std::chrono::steady_clock Clock;
+
+    FrameQueue queue;
+    EmulationThread emulation(system, &queue);
+    std::vector<double> latencies;
+    unsigned long repeated = 0;
+
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / presentHz));
+    Clock::time_point next = Clock::now();
+    auto start = Clock::now();
+
+    emulation.start(throttled ? NTSC_FRAMES_PER_SECOND : 0, frames);
+
+    while (true) {
+        // checked before acquiring, so the last frame is still picked up once the thread is done
+        bool finished = !emulation.isRunning();
+
+        if (queue.acquire()) {
+            latencies.push_back((FrameQueue::now() - queue.getFrontBuffer()->timestamp) / 1e6);
+            if (video != nullptr) {
+                video->submit(queue.getFrontBuffer());
+            }
+        } else if (finished) {
+            break;
+        } else {
+            repeated++;
+        }
+
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+
+    emulation.stop();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf("Ran %lu frames in %.3f s, presenting at %.2f Hz\n", emulation.getFramesRun(), seconds, presentHz);
+    printf("frames/sec: %.2f\n", emulation.getFramesRun() / seconds);
+    printf("presented: %zu, dropped: %u, repeated: %lu\n", latencies.size(), queue.getDroppedCount(), repeated);
+
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        double total = 0;
+        for (double latency : latencies) {
+            total += latency;
+        }
+
+        printf("latency ms: min %.3f, mean %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+               latencies.front(), total / latencies.size(), getPercentile(latencies, 50),
+               getPercentile(latencies, 95), getPercentile(latencies, 99), latencies.back());
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned long frames = 600;
+    unsigned long cycles = 0;
+    unsigned long stateIterations = 0;
+    unsigned long rewindMiB = 0;
+    unsigned long batchInstances = 0;
+    unsigned long batchThreads = 0;
+    bool pinThreads = false;
+    bool threaded = false;
+    bool throttled = true;
+    double presentHz = 60;
+    bool nullVideo = false;
+    const char *ppmPattern = nullptr;
+    const char *crcPath = nullptr;
+    unsigned long ntscScale = 0;
+    int scaleType = -1;
+    unsigned long filterThreads = 1;
+    const char *tracePath = nullptr;
+    const char *scanDirectory = nullptr;
+    const char *databasePath = nullptr;
+    bool nestest = false;
+    const char *romPath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = strtoul(argv[++i], nullptr, 0);
+            cycles = 0;
+        } else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+            cycles = strtoul(argv[++i], nullptr, 0);
+            frames = 0;
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (!strcmp(argv[i], "--bench-states") && i + 1 < argc) {
+            stateIterations = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--rewind") && i + 1 < argc) {
+            rewindMiB = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--batch") && i + 1 < argc) {
+            batchInstances = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            batchThreads = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--pin")) {
+            pinThreads = true;
+        } else if (!strcmp(argv[i], "--threaded")) {
+            threaded = true;
+        } else if (!strcmp(argv[i], "--present-hz") && i + 1 < argc) {
+            presentHz = strtod(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "--unthrottled")) {
+            throttled = false;
+        } else if (!strcmp(argv[i], "--null-video")) {
+            nullVideo = true;
+        } else if (!strcmp(argv[i], "--ppm") && i + 1 < argc) {
+            ppmPattern = argv[++i];
+        } else if (!strcmp(argv[i], "--crc") && i + 1 < argc) {
+            crcPath = argv[++i];
+        } else if (!strcmp(argv[i], "--ntsc") && i + 1 < argc) {
+            ntscScale = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--scale") && i + 1 < argc) {
+            const char *name = argv[++i];
+            for (int type = 0; type < ScaleFilterType_Count; type++) {
+                if (!strcmp(name, ScaleFilter::getName(type))) {
+                    scaleType = type;
+                }
+            }
+            if (scaleType < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--filter-threads") && i + 1 < argc) {
+            filterThreads = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--scan") && i + 1 < argc) {
+            scanDirectory = argv[++i];
+        } else if (!strcmp(argv[i], "--db") && i + 1 < argc) {
+            databasePath = argv[++i];
+        } else if (!strcmp(argv[i], "--nestest")) {
+            nestest = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            romPath = argv[i];
+        }
+    }
+
+    if (scanDirectory) {
+        if (!databasePath) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runScan(scanDirectory, databasePath, batchThreads);
+    }
+
+    if (!romPath || (ntscScale != 0 && ntscScale != 2 && ntscScale != 3) || (ntscScale != 0 && scaleType >= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (ppmPattern != nullptr && !HeadlessVideoSink::isValidPpmPattern(ppmPattern)) {
+        fprintf(stderr, "--ppm pattern needs exactly one integer conversion for the frame number, e.g. frame%%05u.ppm\n");
+        return 1;
+    }
+
+    if (batchInstances > 0) {
+        return runBatch(romPath, batchInstances, frames, batchThreads, pinThreads);
+    }
+
+    RomDatabase database;
+    if (databasePath && !database.load(databasePath)) {
+        fprintf(stderr, "%s is not a ROM database\n", databasePath);
+        return 1;
+    }
+
+    System system;
+    if (databasePath) {
+        system.setRomDatabase(&database);
+    }
+    printf("Load %s\n", romPath);
+    const char *error = system.loadRom(romPath);
+    if (error) {
+        fprintf(stderr, "Failed to load ROM %s: %s\n", romPath, error);
+        return 1;
+    }
+    const Rom *rom = system.getRom();
+    if (rom->headerCorrected) {
+        printf("Header corrected from the database: mapper %d.%d\n", rom->mapperNumber, rom->submapper);
+    }
+
+    system.start();
+    printf("Started\n");
+    if (nestest) {
+        system.getCpu()->registers.pc = NESTEST_AUTOMATION_START;
+    }
+
+    // frames are only handed to a sink when asked for, so the default is emulation alone
+    VideoSink *video = nullptr;
+    HeadlessVideoSink *headlessVideo = nullptr;
+    if (ppmPattern != nullptr || crcPath != nullptr) {
+        video = headlessVideo = new HeadlessVideoSink(ppmPattern, crcPath);
+    } else if (nullVideo || ntscScale > 0 || scaleType >= 0) {
+        video = new NullVideoSink;
+    }
+
+    if (ntscScale > 0) {
+        video->setFilter(new NtscFilter(ntscScale, filterThreads));
+    } else if (scaleType >= 0) {
+        video->setFilter(new ScaleFilter(scaleType, filterThreads));
+    }
+
+    if (video != nullptr && !video->init()) {
+        fprintf(stderr, "Failed to open %s\n", crcPath);
+        return 1;
+    }
+
+    if (threaded) {
+        if (presentHz <= 0 || frames == 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        runThreaded(&system, frames, presentHz, throttled, video);
+        return finishVideo(video, headlessVideo) ? 0 : 1;
+    }
+
+    Cpu *cpu = system.getCpu();
+    if (tracePath != nullptr && !cpu->startTrace(tracePath)) {
+        fprintf(stderr, "Failed to open %s\n", tracePath);
+        return 1;
+    }
+
+    // only recorded when running whole frames, as that's when a frontend would record
+    RewindBuffer *rewind = nullptr;
+    if (rewindMiB > 0) {
+        rewind = new RewindBuffer(rewindMiB << 20);
+    }
+    SystemState rewindState;
+    double rewindSeconds = 0;
+
+    unsigned startCycles = cpu->getTotalCycles();
+    uint64_t startInstructions = cpu->getTotalInstructions();
+    unsigned startFrames = system.getFrameCount();
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (cycles > 0) {
+        // split into chunks so the budget can't overflow the cycle counters in one call
+        while (cycles > 0) {
+            unsigned chunk = cycles > 0x100000 ? 0x100000 : static_cast<unsigned>(cycles);
+            system.runCycles(chunk);
+            cycles -= chunk;
+        }
+    } else {
+        for (unsigned long i = 0; i < frames; i++) {
+            system.runFrame();
+
+            if (video != nullptr) {
+                video->submit(system.getPpu()->getFramebuffer(), system.getPpu()->getRowHashes(), system.getFrameCount());
+            }
+
+            if (rewind != nullptr) {
+                auto recordStart = std::chrono::steady_clock::now();
+                system.saveState(&rewindState);
+                rewind->push(rewindState);
+                rewindSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - recordStart).count();
+            }
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    cpu->stopTrace();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double ranCycles = cpu->getTotalCycles() - startCycles;
+    double ranInstructions = static_cast<double>(cpu->getTotalInstructions() - startInstructions);
+    double ranFrames = system.getFrameCount() - startFrames;
+
+    printf("Ran %.0f cycles, %.0f instructions, %.0f frames in %.3f s\n", ranCycles, ranInstructions, ranFrames, seconds);
+    printf("cycles/sec: %.0f\n", ranCycles / seconds);
+    printf("instructions/sec: %.0f\n", ranInstructions / seconds);
+    printf("frames/sec: %.2f\n", ranFrames / seconds);
+
+    if (rewind != nullptr) {
+        rewind->flush();
+
+        unsigned rewindFrames = rewind->getFrameCount();
+        double history = rewindFrames / NTSC_FRAMES_PER_SECOND;
+        double used = static_cast<double>(rewind->getUsedBytes());
+
+        printf("rewind: %u frames (%.1f s) in %.1f KiB of %.1f KiB\n", rewindFrames, history, used / 1024,
+               rewind->getCapacity() / 1024.0);
+        if (rewindFrames > 0) {
+            printf("rewind KiB per second of history: %.2f\n", used / 1024 / history);
+        }
+        if (ranFrames > 0) {
+            printf("rewind overhead per frame: %.2f us\n", rewindSeconds * 1e6 / ranFrames);
+        }
+
+        delete rewind;
+    }
+
+    bool videoWritten = finishVideo(video, headlessVideo);
+
+    if (stateIterations > 0) {
+        benchStates(&system, stateIterations);
+    }
+
+    return videoWritten ? 0 : 1;
+}
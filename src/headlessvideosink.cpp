@@ -0,0 +1,143 @@
+#include <cstring>
+#include <vector>
+#include "headlessvideosink.h"
+#include "ppu.h"
+#include "romhash.h"
+
+HeadlessVideoSink::HeadlessVideoSink(const char *ppmPattern, const char *crcPath) {
+    this->ppmPattern = ppmPattern;
+    this->crcPath = crcPath;
+    this->crcFile = nullptr;
+    this->failed = false;
+    this->frameCount = 0;
+    this->lastCrc = 0;
+}
+
+HeadlessVideoSink::~HeadlessVideoSink() {
+    shutdown();
+}
+
+// exactly one integer conversion, with no length modifier, with any flags, width and precision, and %% anywhere
+bool HeadlessVideoSink::isValidPpmPattern(const char *pattern) {
+    unsigned conversions = 0;
+
+    for (const char *c = pattern; *c; c++) {
+        if (*c != '%') {
+            continue;
+        }
+        c++;
+        if (*c == '%') {
+            continue;
+        }
+
+        while (*c && strchr("-+ #0", *c)) {
+            c++;
+        }
+        while (*c >= '0' && *c <= '9') {
+            c++;
+        }
+        if (*c == '.') {
+            c++;
+            while (*c >= '0' && *c <= '9') {
+                c++;
+            }
+        }
+        if (!*c || !strchr("diouxX", *c)) {
+            return false;
+        }
+        conversions++;
+    }
+
+    return conversions == 1;
+}
+
+bool HeadlessVideoSink::init() {
+    if (ppmPattern != nullptr && !isValidPpmPattern(ppmPattern)) {
+        return false;
+    }
+
+    if (crcPath != nullptr) {
+        crcFile = fopen(crcPath, "w");
+        if (!crcFile) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HeadlessVideoSink::shutdown() {
+    if (crcFile) {
+        if (ferror(crcFile) || fclose(crcFile) != 0) {
+            fprintf(stderr, "Failed to write %s\n", crcPath);
+            failed = true;
+        }
+        crcFile = nullptr;
+    }
+}
+
+void HeadlessVideoSink::present(const VideoFrame &frame) {
+    frameCount++;
+
+    // the pixels are stored little endian whatever the host, so the CRCs match between machines
+    byte bytes[2 * PPU_WIDTH];
+    uint32_t crc = 0;
+    for (unsigned y = 0; y < frame.height; y++) {
+        const uint16_t *row = frame.indexed + y * frame.width;
+        for (unsigned x = 0; x < frame.width; x++) {
+            bytes[x * 2] = row[x] & 0xFF;
+            bytes[x * 2 + 1] = row[x] >> 8;
+        }
+        crc = crc32(bytes, frame.width * 2, crc);
+    }
+    lastCrc = crc;
+
+    if (crcFile) {
+        fprintf(crcFile, "%u %08x\n", frame.number, lastCrc);
+    }
+
+    if (ppmPattern != nullptr && !writePpm(frame)) {
+        failed = true;
+    }
+}
+
+bool HeadlessVideoSink::writePpm(const VideoFrame &frame) {
+    // Only the first failure is reported, as a full disk would fail every frame after it.
+    // The pattern was checked by init, so the frame number is all it formats.
+    char path[512];
+    int length = snprintf(path, sizeof(path), ppmPattern, frame.number);
+    if (length < 0 || static_cast<size_t>(length) >= sizeof(path)) {
+        if (!failed) {
+            fprintf(stderr, "PPM path too long\n");
+        }
+        return false;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        if (!failed) {
+            fprintf(stderr, "Failed to open %s\n", path);
+        }
+        return false;
+    }
+
+    bool written = fprintf(f, "P6\n%u %u\n255\n", frame.rgbaWidth, frame.rgbaHeight) > 0;
+
+    std::vector<byte> row(3 * frame.rgbaWidth);
+    for (unsigned y = 0; y < frame.rgbaHeight; y++) {
+        const uint32_t *pixels = frame.rgba + y * frame.rgbaWidth;
+        for (unsigned x = 0; x < frame.rgbaWidth; x++) {
+            row[x * 3] = pixels[x] & 0xFF;
+            row[x * 3 + 1] = (pixels[x] >> 8) & 0xFF;
+            row[x * 3 + 2] = (pixels[x] >> 16) & 0xFF;
+        }
+        written = written && fwrite(row.data(), 3, frame.rgbaWidth, f) == frame.rgbaWidth;
+    }
+
+    if (fclose(f) != 0) {
+        written = false;
+    }
+    if (!written && !failed) {
+        fprintf(stderr, "Failed to write %s\n", path);
+    }
+    return written;
+}
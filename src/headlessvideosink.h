@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include "videosink.h"
+
+// Writes each frame out for checking rendering without a display: as a PPM image, named by
+// passing the frame number through ppmPattern, and/or as a line of frame number and CRC-32.
+// Either can be left out by passing nullptr.
+class HeadlessVideoSink : public VideoSink {
+public:
+    HeadlessVideoSink(const char *ppmPattern, const char *crcPath);
+    ~HeadlessVideoSink();
+
+    // the pattern is a printf format, so it has to take the frame number and nothing else
+    static bool isValidPpmPattern(const char *pattern);
+
+    // fails on a bad pattern as well as when the CRC file can't be created
+    bool init() override;
+    void shutdown() override;
+
+    // set once any PPM or CRC line couldn't be written, the run carries on regardless
+    bool hasFailed() const { return this->failed; }
+
+    unsigned getFrameCount() const { return this->frameCount; }
+    // over the indexed pixels, so emphasis and greyscale changes are caught as well
+    uint32_t getLastCrc() const { return this->lastCrc; }
+
+protected:
+    bool wantsRgba() const override { return this->ppmPattern != nullptr; }
+    void present(const VideoFrame &frame) override;
+
+private:
+    bool writePpm(const VideoFrame &frame);
+
+    const char *ppmPattern;
+    const char *crcPath;
+    FILE *crcFile;
+    bool failed;
+
+    unsigned frameCount;
+    uint32_t lastCrc;
+};
@@ -0,0 +1,464 @@
+#include <cstring>
+#include "inflate.h"
+
+static const uint16_t lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const byte lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const byte distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+// the order the code length code lengths come in, most used first
+static const byte codeLengthOrder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+// false when there are more codes of some length than fit, incomplete codes are left to fail in decode
+static bool buildTable(InflateTable *table, const byte *lengths, unsigned count) {
+    memset(table->counts, 0, sizeof(table->counts));
+    for (unsigned i = 0; i < count; i++) {
+        table->counts[lengths[i]]++;
+    }
+
+    int left = 1;
+    for (unsigned length = 1; length < 16; length++) {
+        left = (left << 1) - table->counts[length];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    // symbols sorted by code length, then by value, which is the order of their codes
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (unsigned length = 1; length < 15; length++) {
+        offsets[length + 1] = offsets[length] + table->counts[length];
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (lengths[i] != 0) {
+            table->symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+        }
+    }
+
+    // Codes are sent most significant bit first, so they're reversed to index the table by the bits
+    // as they come out of the buffer, and a short code fills every entry that starts with it.
+    memset(table->fast, 0, sizeof(table->fast));
+    unsigned code = 0;
+    unsigned index = 0;
+    for (unsigned length = 1; length <= INFLATE_FAST_BITS; length++) {
+        for (unsigned i = 0; i < table->counts[length]; i++) {
+            unsigned reversed = 0;
+            for (unsigned bit = 0; bit < length; bit++) {
+                reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+            }
+
+            uint16_t entry = static_cast<uint16_t>((table->symbols[index] << 4) | length);
+            for (unsigned fill = reversed; fill < (1U << INFLATE_FAST_BITS); fill += 1U << length) {
+                table->fast[fill] = entry;
+            }
+            code++;
+            index++;
+        }
+        code <<= 1;
+    }
+
+    return true;
+}
+
+// the codes blocks of type 1 use instead of sending their own
+struct InflateFixedTables {
+    InflateTable lengths;
+    InflateTable distances;
+
+    InflateFixedTables() {
+        byte table[288];
+        memset(table, 8, 144);
+        memset(table + 144, 9, 112);
+        memset(table + 256, 7, 24);
+        memset(table + 280, 8, 8);
+        buildTable(&lengths, table, 288);
+
+        memset(table, 5, 30);
+        buildTable(&distances, table, 30);
+    }
+};
+
+Inflater::Inflater(const byte *data, size_t size) {
+    this->in = data;
+    this->inEnd = data + size;
+    this->bitBuffer = 0;
+    this->bitCount = 0;
+    this->overrun = false;
+    this->block = InflateBlock_None;
+    this->last = false;
+    this->finished = false;
+    this->storedLeft = 0;
+    this->matchLength = 0;
+    this->matchDistance = 0;
+    this->lengths = nullptr;
+    this->distances = nullptr;
+    this->out = nullptr;
+    this->outSize = 0;
+    this->outCapacity = 0;
+}
+
+// tops the buffer up to at least 56 bits, eight bytes at a time while there are that many left
+void Inflater::refill() {
+    if (inEnd - in >= 8) {
+        uint64_t next;
+        memcpy(&next, in, 8);
+        bitBuffer |= next << bitCount;
+        in += (63 - bitCount) >> 3;
+        bitCount |= 56;
+        return;
+    }
+
+    while (bitCount <= 56 && in < inEnd) {
+        bitBuffer |= static_cast<uint64_t>(*in++) << bitCount;
+        bitCount += 8;
+    }
+}
+
+unsigned Inflater::getBits(unsigned count) {
+    if (bitCount < count) {
+        refill();
+        if (bitCount < count) {
+            overrun = true;
+            bitBuffer = 0;
+            bitCount = count;
+        }
+    }
+
+    unsigned value = static_cast<unsigned>(bitBuffer & ((static_cast<uint64_t>(1) << count) - 1));
+    bitBuffer >>= count;
+    bitCount -= count;
+    return value;
+}
+
+// returns the next symbol, or -1 for a code the table doesn't have
+int Inflater::decode(const InflateTable *table) {
+    if (bitCount < 15) {
+        refill();
+    }
+
+    unsigned entry = table->fast[bitBuffer & ((1U << INFLATE_FAST_BITS) - 1)];
+    unsigned length = entry & 15;
+    int symbol = static_cast<int>(entry >> 4);
+
+    // longer codes are worked out a bit at a time from how many codes there are of each length
+    if (entry == 0) {
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        symbol = -1;
+
+        for (length = 1; length < 16; length++) {
+            code |= static_cast<int>((bitBuffer >> (length - 1)) & 1);
+            int count = table->counts[length];
+            if (code - count < first) {
+                symbol = table->symbols[index + (code - first)];
+                break;
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        if (symbol < 0) {
+            return -1;
+        }
+    }
+
+    if (length > bitCount) {
+        overrun = true;
+        length = bitCount;
+    }
+    bitBuffer >>= length;
+    bitCount -= length;
+    return symbol;
+}
+
+const char *Inflater::inflate(byte *out, size_t capacity, size_t *written) {
+    return resume(out, 0, capacity, written);
+}
+
+const char *Inflater::resume(byte *out, size_t history, size_t capacity, size_t *written) {
+    this->out = out;
+    this->outSize = history;
+    this->outCapacity = capacity;
+
+    const char *error = inflateBlocks();
+    *written = outSize - history;
+    return error;
+}
+
+const char *Inflater::inflateBlocks() {
+    static const InflateFixedTables fixed;
+
+    const char *error = nullptr;
+    while (!error && outSize < outCapacity) {
+        switch (block) {
+            case InflateBlock_None: {
+                if (last) {
+                    finished = true;
+                    return nullptr;
+                }
+                last = getBits(1) != 0;
+
+                switch (getBits(2)) {
+                    case 0: {
+                        error = inflateStoredHeader();
+                        break;
+                    }
+
+                    case 1: {
+                        lengths = &fixed.lengths;
+                        distances = &fixed.distances;
+                        block = InflateBlock_Codes;
+                        break;
+                    }
+
+                    case 2: {
+                        error = inflateDynamicTables();
+                        if (!error) {
+                            lengths = &lengthTable;
+                            distances = &distanceTable;
+                            block = InflateBlock_Codes;
+                        }
+                        break;
+                    }
+
+                    default: {
+                        error = "bad block type";
+                        break;
+                    }
+                }
+                break;
+            }
+
+            case InflateBlock_Stored: {
+                error = inflateStored();
+                break;
+            }
+
+            case InflateBlock_Codes: {
+                error = inflateCodes();
+                break;
+            }
+        }
+
+        if (!error && overrun) {
+            error = "truncated";
+        }
+    }
+
+    // a full buffer that the stream also ends with still has the end of its last block to read
+    if (!error && block == InflateBlock_None && last) {
+        finished = true;
+    }
+    return error;
+}
+
+// starts on a byte boundary with the length and its complement
+const char *Inflater::inflateStoredHeader() {
+    getBits(bitCount & 7);
+    unsigned length = getBits(16);
+    unsigned complement = getBits(16);
+    if (length != (~complement & 0xFFFF)) {
+        return "bad stored block length";
+    }
+
+    storedLeft = length;
+    block = InflateBlock_Stored;
+    return nullptr;
+}
+
+// then the bytes as they are
+const char *Inflater::inflateStored() {
+    size_t length = storedLeft;
+    if (length > outCapacity - outSize) {
+        length = outCapacity - outSize;
+    }
+    storedLeft -= length;
+
+    // whatever was already read into the bit buffer comes first
+    while (length > 0 && bitCount >= 8) {
+        out[outSize++] = static_cast<byte>(getBits(8));
+        length--;
+    }
+
+    // refill leaves the next bytes above bitCount, which the copy below is about to skip past
+    if (bitCount == 0) {
+        bitBuffer = 0;
+    }
+
+    if (length > static_cast<size_t>(inEnd - in)) {
+        return "truncated";
+    }
+    memcpy(out + outSize, in, length);
+    in += length;
+    outSize += length;
+
+    if (storedLeft == 0) {
+        block = InflateBlock_None;
+    }
+    return nullptr;
+}
+
+// the literal/length and distance code lengths, themselves Huffman coded with runs
+const char *Inflater::inflateDynamicTables() {
+    unsigned lengthCount = getBits(5) + 257;
+    unsigned distanceCount = getBits(5) + 1;
+    unsigned codeLengthCount = getBits(4) + 4;
+    if (lengthCount > 286 || distanceCount > 30) {
+        return "bad table sizes";
+    }
+
+    byte lengths[286 + 30];
+    memset(lengths, 0, 19);
+    for (unsigned i = 0; i < codeLengthCount; i++) {
+        lengths[codeLengthOrder[i]] = static_cast<byte>(getBits(3));
+    }
+    // the length table is free until the real one is built, so it holds the code length code
+    if (!buildTable(&lengthTable, lengths, 19)) {
+        return "bad code lengths";
+    }
+
+    unsigned total = lengthCount + distanceCount;
+    unsigned index = 0;
+    while (index < total) {
+        int symbol = decode(&lengthTable);
+        if (symbol < 0 || overrun) {
+            return "bad code lengths";
+        }
+
+        if (symbol < 16) {
+            lengths[index++] = static_cast<byte>(symbol);
+            continue;
+        }
+
+        byte value = 0;
+        unsigned repeat;
+        if (symbol == 16) {
+            if (index == 0) {
+                return "repeat with no previous length";
+            }
+            value = lengths[index - 1];
+            repeat = 3 + getBits(2);
+        } else if (symbol == 17) {
+            repeat = 3 + getBits(3);
+        } else {
+            repeat = 11 + getBits(7);
+        }
+
+        if (index + repeat > total) {
+            return "too many code lengths";
+        }
+        memset(lengths + index, value, repeat);
+        index += repeat;
+    }
+
+    if (lengths[256] == 0) {
+        return "no end of block code";
+    }
+    if (!buildTable(&lengthTable, lengths, lengthCount) || !buildTable(&distanceTable, lengths + lengthCount, distanceCount)) {
+        return "bad code lengths";
+    }
+    return nullptr;
+}
+
+const char *Inflater::inflateCodes() {
+    // the rest of a match the last buffer ran out in the middle of
+    if (matchLength > 0) {
+        if (matchDistance > outSize) {
+            return "distance too far back";
+        }
+        copyMatch();
+        if (outSize == outCapacity) {
+            return nullptr;
+        }
+    }
+
+    for (;;) {
+        if (overrun) {
+            return "truncated";
+        }
+
+        int symbol = decode(lengths);
+        if (symbol < 256) {
+            if (symbol < 0) {
+                return "bad literal/length code";
+            }
+            out[outSize++] = static_cast<byte>(symbol);
+            if (outSize == outCapacity) {
+                return nullptr;
+            }
+            continue;
+        }
+
+        if (symbol == 256) {
+            block = InflateBlock_None;
+            return nullptr;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            return "bad length code";
+        }
+        matchLength = lengthBase[symbol] + getBits(lengthExtra[symbol]);
+
+        symbol = decode(distances);
+        if (symbol < 0 || symbol >= 30) {
+            return "bad distance code";
+        }
+        matchDistance = distanceBase[symbol] + getBits(distanceExtra[symbol]);
+        if (matchDistance > outSize) {
+            return "distance too far back";
+        }
+
+        copyMatch();
+        if (outSize == outCapacity) {
+            return nullptr;
+        }
+    }
+}
+
+// as much of the current match as fits, the rest is left in matchLength
+void Inflater::copyMatch() {
+    size_t length = matchLength;
+    if (length > outCapacity - outSize) {
+        length = outCapacity - outSize;
+    }
+    matchLength -= length;
+
+    // A distance shorter than the length repeats what's being written, which can still go eight
+    // bytes at a time when the distance is at least that, and is a fill when it's one byte.
+    size_t distance = matchDistance;
+    byte *to = out + outSize;
+    const byte *from = to - distance;
+    if (distance >= length) {
+        memcpy(to, from, length);
+    } else if (distance == 1) {
+        memset(to, *from, length);
+    } else if (distance >= 8) {
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            memcpy(to + i, from + i, 8);
+        }
+        for (; i < length; i++) {
+            to[i] = from[i];
+        }
+    } else {
+        for (size_t i = 0; i < length; i++) {
+            to[i] = from[i];
+        }
+    }
+
+    outSize += length;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "armadadef.h"
+
+const unsigned INFLATE_FAST_BITS = 10;
+// how far back a back-reference can reach, and so how much output resume needs to be given again
+const size_t INFLATE_WINDOW_SIZE = 32768;
+
+enum {
+    InflateBlock_None,
+    InflateBlock_Stored,
+    InflateBlock_Codes,
+};
+
+// canonical Huffman code, with every code up to INFLATE_FAST_BITS long looked up in one go
+struct InflateTable {
+    // symbol << 4 | length, 0 when the code is longer than the table
+    uint16_t fast[1 << INFLATE_FAST_BITS];
+    uint16_t counts[16];
+    uint16_t symbols[288];
+};
+
+// Raw DEFLATE (RFC 1951) decoder. The whole output goes into one buffer, which is also the window
+// back-references copy from, so nothing is buffered on the way. It stops as soon as the buffer is
+// full, so the start of a stream can be looked at without decompressing the rest, and carries on
+// from there when asked, with the end of what it gave before copied in front of the next buffer.
+class Inflater {
+public:
+    Inflater(const byte *data, size_t size);
+
+    // decompresses up to capacity bytes into out, returns why the stream is bad or null
+    const char *inflate(byte *out, size_t capacity, size_t *written);
+    // Carries on where the last call stopped. out starts with history bytes, the last up to
+    // INFLATE_WINDOW_SIZE bytes written so far, and written counts only the new ones.
+    const char *resume(byte *out, size_t history, size_t capacity, size_t *written);
+    // true once the end of the last block has been read
+    bool isFinished() const { return this->finished; }
+
+private:
+    void refill();
+    unsigned getBits(unsigned count);
+    int decode(const InflateTable *table);
+
+    const char *inflateBlocks();
+    const char *inflateStoredHeader();
+    const char *inflateStored();
+    const char *inflateDynamicTables();
+    const char *inflateCodes();
+    void copyMatch();
+
+    const byte *in;
+    const byte *inEnd;
+    uint64_t bitBuffer;
+    unsigned bitCount;
+    // set when bits past the end of the input were used
+    bool overrun;
+
+    // where the last call stopped, which can be partway through a block or a match
+    int block;
+    bool last;
+    bool finished;
+    size_t storedLeft;
+    size_t matchLength;
+    size_t matchDistance;
+    const InflateTable *lengths;
+    const InflateTable *distances;
+
+    byte *out;
+    size_t outSize;
+    size_t outCapacity;
+
+    InflateTable lengthTable;
+    InflateTable distanceTable;
+};
@@ -0,0 +1,318 @@
+// The inflater against streams made by zlib and by hand, and RomImage looking inside gzip and zip
+// files. Run by ctest.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "inflate.h"
+#include "romimage.h"
+#include "romhash.h"
+#include "rom.h"
+
+static unsigned failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// raw deflate from zlib at level 0
+static const byte storedBlock[] = {
+    0x01, 0x1F, 0x00, 0xE0, 0xFF, 0x6B, 0x65, 0x70, 0x74, 0x20, 0x61, 0x73, 0x20, 0x69, 0x74, 0x20,
+    0x69, 0x73, 0x2C, 0x20, 0x6E, 0x6F, 0x20, 0x63, 0x6F, 0x64, 0x65, 0x73, 0x20, 0x61, 0x74, 0x20,
+    0x61, 0x6C, 0x6C, 0x0A,
+};
+static const char storedText[] = "kept as it is, no codes at all\n";
+
+// zlib with Z_FIXED, literals and matches
+static const byte fixedBlock[] = {
+    0x4B, 0xCB, 0xAC, 0x48, 0x4D, 0x51, 0x48, 0xCE, 0x4F, 0x49, 0x2D, 0xD6, 0x51, 0x48, 0xC3, 0xC1,
+    0xE1, 0x02, 0x00,
+};
+static const char fixedText[] = "fixed codes, fixed codes, fixed codes\n";
+
+// zlib at level 9, one block with its own codes for getDynamicText
+static const byte dynamicBlock[] = {
+    0x9D, 0xD2, 0xC9, 0x0D, 0x80, 0x20, 0x14, 0x45, 0xD1, 0xBD, 0x55, 0xBC, 0x02, 0x5C, 0x38, 0x0F,
+    0xE5, 0x28, 0xA0, 0xFC, 0x88, 0xB0, 0xE0, 0x27, 0xC4, 0xEE, 0x8D, 0x25, 0xF8, 0x0A, 0x38, 0xAB,
+    0x7B, 0x83, 0x44, 0x87, 0x06, 0xE9, 0x80, 0x7A, 0x07, 0xFB, 0xC4, 0xED, 0x16, 0x83, 0x3D, 0x24,
+    0x73, 0xD5, 0x28, 0xA2, 0x1E, 0xA2, 0x19, 0xA9, 0x44, 0x98, 0x64, 0x1D, 0x82, 0x8B, 0xA7, 0xFA,
+    0x5C, 0x85, 0x8F, 0xB5, 0x1C, 0xEB, 0x38, 0xD6, 0x73, 0x6C, 0xE0, 0xD8, 0xC8, 0xB1, 0x89, 0x63,
+    0x33, 0xC7, 0x16, 0x8E, 0xAD, 0x64, 0x6E, 0x76, 0x93, 0xFF, 0x9F, 0xBC,
+};
+
+// By hand: a fixed block of "Goodbye, ", a stored block of 40 bytes, then a final fixed block. The
+// first block is decoded with eight-byte refills, so the stored header and the start of its bytes
+// are already in the bit buffer when it starts, and the last block has to start clean after it.
+static const byte fixedThenStored[] = {
+    0x72, 0xCF, 0xCF, 0x4F, 0x49, 0xAA, 0x4C, 0xD5, 0x51, 0x00, 0x00, 0x28, 0x00, 0xD7, 0xFF, 0x73,
+    0x74, 0x6F, 0x72, 0x65, 0x64, 0x20, 0x72, 0x69, 0x67, 0x68, 0x74, 0x20, 0x61, 0x66, 0x74, 0x65,
+    0x72, 0x20, 0x61, 0x20, 0x66, 0x61, 0x73, 0x74, 0x20, 0x72, 0x65, 0x66, 0x69, 0x6C, 0x6C, 0x2E,
+    0x2E, 0x2E, 0x2E, 0x2E, 0x2E, 0x2E, 0x0A, 0x4B, 0xAA, 0x4C, 0xE5, 0x02, 0x00,
+};
+static const char fixedThenStoredText[] = "Goodbye, stored right after a fast refill.......\nbye\n";
+
+// by hand: a fixed block starting with a 3 byte match one byte back
+static const byte tooFarBack[] = {
+    0x03, 0x02, 0x00,
+};
+
+// zlib with Z_FIXED, 200 'r's as one literal and matches one byte back
+static const byte longRun[] = {
+    0x2B, 0x2A, 0x1A, 0x1E, 0x00, 0x00,
+};
+
+static std::string getDynamicText() {
+    std::string text;
+    for (int i = 0; i < 12; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "line %d of the dynamic block, with its own code lengths\n", i);
+        text += line;
+    }
+    return text;
+}
+
+// inflates the whole stream into a buffer one byte bigger than expected, so running on is seen
+static bool inflatesTo(const byte *data, size_t size, const void *expected, size_t expectedSize) {
+    std::vector<byte> out(expectedSize + 1);
+    size_t written;
+    Inflater inflater(data, size);
+    const char *error = inflater.inflate(out.data(), out.size(), &written);
+    return !error && inflater.isFinished() && written == expectedSize && memcmp(out.data(), expected, expectedSize) == 0;
+}
+
+static void testBlockTypes() {
+    check(inflatesTo(storedBlock, sizeof(storedBlock), storedText, strlen(storedText)), "stored block");
+    check(inflatesTo(fixedBlock, sizeof(fixedBlock), fixedText, strlen(fixedText)), "fixed block");
+    std::string dynamicText = getDynamicText();
+    check(inflatesTo(dynamicBlock, sizeof(dynamicBlock), dynamicText.data(), dynamicText.size()), "dynamic block");
+    check(inflatesTo(fixedThenStored, sizeof(fixedThenStored), fixedThenStoredText, strlen(fixedThenStoredText)),
+        "stored block after a fast refill");
+}
+
+static void testStopAndResume() {
+    // 100 falls in the middle of the first match
+    byte out[INFLATE_WINDOW_SIZE];
+    size_t written;
+    Inflater inflater(longRun, sizeof(longRun));
+    check(inflater.inflate(out, 100, &written) == nullptr && written == 100, "stops at capacity mid-match");
+    check(!inflater.isFinished(), "isn't finished mid-match");
+
+    bool same = true;
+    for (size_t i = 0; i < written; i++) {
+        same = same && out[i] == 'r';
+    }
+    check(same, "first part of the match");
+
+    // the rest comes after the last bytes given back as history
+    const char *error = inflater.resume(out, 10, sizeof(out), &written);
+    check(error == nullptr && written == 100 && inflater.isFinished(), "resumes the rest of the match");
+    same = true;
+    for (size_t i = 0; i < 10 + written; i++) {
+        same = same && out[i] == 'r';
+    }
+    check(same, "rest of the match");
+
+    // a stored block stopped partway carries on from the bit buffer and then the input
+    Inflater stored(fixedThenStored, sizeof(fixedThenStored));
+    check(stored.inflate(out, 12, &written) == nullptr && written == 12, "stops inside a stored block");
+    error = stored.resume(out, 12, sizeof(out), &written);
+    check(error == nullptr && written == strlen(fixedThenStoredText) - 12 && stored.isFinished(), "resumes a stored block");
+    check(memcmp(out, fixedThenStoredText, strlen(fixedThenStoredText)) == 0, "stored block in two parts");
+}
+
+static void testBadStreams() {
+    byte out[256];
+    size_t written;
+
+    Inflater farBack(tooFarBack, sizeof(tooFarBack));
+    const char *error = farBack.inflate(out, sizeof(out), &written);
+    check(error != nullptr && strcmp(error, "distance too far back") == 0, "distance too far back");
+
+    // cut short in the middle of the codes, and in the middle of a stored block
+    Inflater dynamic(dynamicBlock, sizeof(dynamicBlock) / 2);
+    error = dynamic.inflate(out, sizeof(out), &written);
+    check(error != nullptr && !dynamic.isFinished(), "truncated dynamic block");
+
+    Inflater stored(storedBlock, sizeof(storedBlock) - 4);
+    error = stored.inflate(out, sizeof(out), &written);
+    check(error != nullptr && strcmp(error, "truncated") == 0, "truncated stored block");
+}
+
+static void push16(std::vector<byte> *data, unsigned value) {
+    data->push_back(static_cast<byte>(value));
+    data->push_back(static_cast<byte>(value >> 8));
+}
+
+static void push32(std::vector<byte> *data, uint32_t value) {
+    push16(data, value & 0xFFFF);
+    push16(data, value >> 16);
+}
+
+// deflate with nothing but stored blocks, which is enough for the containers around it
+static std::vector<byte> makeStoredDeflate(const std::vector<byte> &data) {
+    std::vector<byte> stream;
+    size_t offset = 0;
+    do {
+        size_t length = data.size() - offset < 0xFFFF ? data.size() - offset : 0xFFFF;
+        stream.push_back(offset + length == data.size() ? 1 : 0);
+        push16(&stream, static_cast<unsigned>(length));
+        push16(&stream, static_cast<unsigned>(~length & 0xFFFF));
+        stream.insert(stream.end(), data.begin() + offset, data.begin() + offset + length);
+        offset += length;
+    } while (offset < data.size());
+    return stream;
+}
+
+// with an extra field and a name, which come before the stream and have to be skipped
+static std::vector<byte> makeGzip(const std::vector<byte> &data) {
+    std::vector<byte> file = { 0x1F, 0x8B, 8, (1 << 2) | (1 << 3), 0, 0, 0, 0, 0, 3 };
+    push16(&file, 4);
+    push32(&file, 0xDEADBEEF);
+    const char *name = "game.nes";
+    file.insert(file.end(), name, name + strlen(name) + 1);
+
+    std::vector<byte> stream = makeStoredDeflate(data);
+    file.insert(file.end(), stream.begin(), stream.end());
+    push32(&file, crc32(data.data(), data.size()));
+    push32(&file, static_cast<uint32_t>(data.size()));
+    return file;
+}
+
+struct ZipEntry {
+    const char *name;
+    std::vector<byte> data;
+    bool deflate;
+};
+
+static std::vector<byte> makeZip(const std::vector<ZipEntry> &entries) {
+    std::vector<byte> file;
+    std::vector<byte> directory;
+    for (const ZipEntry &entry : entries) {
+        std::vector<byte> stored = entry.deflate ? makeStoredDeflate(entry.data) : entry.data;
+        uint32_t crc = crc32(entry.data.data(), entry.data.size());
+        uint32_t localOffset = static_cast<uint32_t>(file.size());
+        size_t nameLength = strlen(entry.name);
+
+        push32(&file, 0x04034B50);
+        push16(&file, 20);
+        push16(&file, 0);
+        push16(&file, entry.deflate ? 8 : 0);
+        push32(&file, 0);
+        push32(&file, crc);
+        push32(&file, static_cast<uint32_t>(stored.size()));
+        push32(&file, static_cast<uint32_t>(entry.data.size()));
+        push16(&file, static_cast<unsigned>(nameLength));
+        push16(&file, 0);
+        file.insert(file.end(), entry.name, entry.name + nameLength);
+        file.insert(file.end(), stored.begin(), stored.end());
+
+        push32(&directory, 0x02014B50);
+        push16(&directory, 20);
+        push16(&directory, 20);
+        push16(&directory, 0);
+        push16(&directory, entry.deflate ? 8 : 0);
+        push32(&directory, 0);
+        push32(&directory, crc);
+        push32(&directory, static_cast<uint32_t>(stored.size()));
+        push32(&directory, static_cast<uint32_t>(entry.data.size()));
+        push16(&directory, static_cast<unsigned>(nameLength));
+        push16(&directory, 0);
+        push16(&directory, 0);
+        push16(&directory, 0);
+        push16(&directory, 0);
+        push32(&directory, 0);
+        push32(&directory, localOffset);
+        directory.insert(directory.end(), entry.name, entry.name + nameLength);
+    }
+
+    uint32_t directoryOffset = static_cast<uint32_t>(file.size());
+    file.insert(file.end(), directory.begin(), directory.end());
+    push32(&file, 0x06054B50);
+    push16(&file, 0);
+    push16(&file, 0);
+    push16(&file, static_cast<unsigned>(entries.size()));
+    push16(&file, static_cast<unsigned>(entries.size()));
+    push32(&file, static_cast<uint32_t>(directory.size()));
+    push32(&file, directoryOffset);
+    push16(&file, 0);
+    return file;
+}
+
+// 16 KiB of PRG and 8 KiB of CHR, with no two banks alike
+static std::vector<byte> makeNromImage() {
+    std::vector<byte> image(sizeof(InesHeader) + 0x4000 + 0x2000);
+    memcpy(image.data(), "NES\x1A\x01\x01\x01", 7);
+    for (size_t i = sizeof(InesHeader); i < image.size(); i++) {
+        image[i] = static_cast<byte>(i * 7 + (i >> 8));
+    }
+    return image;
+}
+
+// returns why the file didn't unpack, or null when it did and gave back image
+static const char *unpackFile(const std::vector<byte> &file, const std::vector<byte> &image) {
+    const char *path = "armadanes-inflatetest.bin";
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return "can't write the temporary file";
+    }
+    fwrite(file.data(), 1, file.size(), f);
+    fclose(f);
+
+    RomImage romImage;
+    const char *error = "can't open the temporary file";
+    if (romImage.open(path)) {
+        error = romImage.unpack();
+        if (!error && (romImage.getSize() != image.size() || memcmp(romImage.getData(), image.data(), image.size()) != 0)) {
+            error = "unpacked image differs";
+        }
+    }
+    romImage.close();
+    remove(path);
+    return error;
+}
+
+static void testContainers() {
+    std::vector<byte> image = makeNromImage();
+
+    check(unpackFile(makeGzip(image), image) == nullptr, "gzip with FEXTRA and FNAME");
+
+    // anything after CHR is still covered by the CRC, and then dropped
+    std::vector<byte> longer = image;
+    longer.insert(longer.end(), 100000, 0x5A);
+    check(unpackFile(makeGzip(longer), image) == nullptr, "gzip with more than the image");
+
+    std::vector<byte> badCrc = makeGzip(longer);
+    badCrc[badCrc.size() - 8] ^= 1;
+    const char *error = unpackFile(badCrc, image);
+    check(error != nullptr && strcmp(error, "CRC mismatch") == 0, "gzip CRC is checked past the image");
+
+    check(unpackFile(makeZip({ { "game.nes", image, false } }), image) == nullptr, "stored zip entry");
+    check(unpackFile(makeZip({ { "readme.txt", longer, true }, { "game.nes", image, true } }), image) == nullptr,
+        "zip whose first entry isn't .nes");
+
+    std::vector<byte> badStored = makeZip({ { "game.nes", image, false } });
+    badStored[30 + strlen("game.nes") + 100] ^= 1;
+    error = unpackFile(badStored, image);
+    check(error != nullptr && strcmp(error, "CRC mismatch") == 0, "stored zip entry CRC is checked");
+
+    error = unpackFile(makeZip({ { "readme.txt", image, true } }), image);
+    check(error != nullptr, "zip with no .nes entry");
+}
+
+int main() {
+    testBlockTypes();
+    testStopAndResume();
+    testBadStreams();
+    testContainers();
+
+    if (failures != 0) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
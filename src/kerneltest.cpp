@@ -0,0 +1,103 @@
+// Every pixel kernel the CPU supports has to give the scalar kernels' output bit for bit. Run by ctest.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "pixelkernels.h"
+#include "ppu.h"
+
+static unsigned failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+const unsigned FRAME_PIXELS = PPU_WIDTH * PPU_HEIGHT;
+
+// random background and sprite lines, with transparent pixels on both
+struct KernelInput {
+    std::vector<byte> background;
+    std::vector<byte> sprites;
+    byte palette[0x20];
+    std::vector<uint32_t> rgbaPalette;
+
+    KernelInput() : background(FRAME_PIXELS), sprites(FRAME_PIXELS), rgbaPalette(RGBA_PALETTE_SIZE) {
+        uint32_t seed = 0x2C02;
+        for (unsigned i = 0; i < FRAME_PIXELS; i++) {
+            seed = seed * 1103515245 + 12345;
+            byte value = (seed >> 16) & 3;
+            background[i] = value ? static_cast<byte>(value | ((seed >> 18) & 0xC)) : 0;
+            sprites[i] = (seed >> 24) & 0x3F;
+            if (!(sprites[i] & 3)) {
+                sprites[i] = 0;
+            }
+        }
+        for (unsigned i = 0; i < 0x20; i++) {
+            palette[i] = static_cast<byte>((i * 13 + 5) & 0x3F);
+        }
+        buildRgbaPalette(rgbaPalette.data());
+    }
+};
+
+struct KernelOutput {
+    std::vector<uint16_t> pixels;
+    std::vector<uint32_t> rgba;
+    std::vector<byte> hits;
+
+    KernelOutput() : pixels(FRAME_PIXELS), rgba(FRAME_PIXELS), hits(PPU_HEIGHT) {}
+};
+
+// Each line has its own mask and emphasis so those are covered as well, and its own length and
+// start, so runs that aren't a whole number of vectors and unaligned pointers are too.
+static void runKernels(const PixelKernels *kernels, const KernelInput &input, KernelOutput *output) {
+    for (unsigned y = 0; y < PPU_HEIGHT; y++) {
+        unsigned start = y & 7;
+        unsigned count = PPU_WIDTH - start - (y * 3 & 31);
+        unsigned offset = y * PPU_WIDTH + start;
+        byte colorMask = (y & 1) ? 0x30 : 0x3F;
+        uint16_t emphasis = static_cast<uint16_t>((y & 7) << PPU_EMPHASIS_SHIFT);
+
+        output->hits[y] = kernels->composite(&input.background[offset], &input.sprites[offset], input.palette,
+                                             &output->pixels[offset], count, colorMask, emphasis);
+        kernels->convertToRgba(&output->pixels[offset], &output->rgba[offset], count, input.rgbaPalette.data());
+    }
+}
+
+static void testKernelsMatch() {
+    KernelInput input;
+    KernelOutput reference;
+    runKernels(getPixelKernels(PixelKernelLevel_Scalar), input, &reference);
+
+    for (int level = PixelKernelLevel_Scalar + 1; level < PixelKernelLevel_Count; level++) {
+        const PixelKernels *kernels = getPixelKernels(level);
+        if (!kernels) {
+            printf("Kernel level %d isn't supported here, skipped\n", level);
+            continue;
+        }
+
+        KernelOutput output;
+        runKernels(kernels, input, &output);
+
+        char what[64];
+        snprintf(what, sizeof(what), "%s composite matches scalar", kernels->name);
+        check(output.pixels == reference.pixels, what);
+        snprintf(what, sizeof(what), "%s sprite 0 hits match scalar", kernels->name);
+        check(output.hits == reference.hits, what);
+        snprintf(what, sizeof(what), "%s RGBA matches scalar", kernels->name);
+        check(output.rgba == reference.rgba, what);
+    }
+}
+
+int main() {
+    testKernelsMatch();
+
+    if (failures != 0) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
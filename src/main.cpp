@@ -8,6 +8,12 @@
 #include "d3d9renderer.h"
 #include "rom.h"
 #include "cpubus.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "framequeue.h"
+#include "emulationthread.h"
+#include "ntscfilter.h"
+#include "scalefilter.h"
 
 #define WINDOWCLASS "ArmadaNesWindowClass"
 
@@ -26,11 +32,19 @@ App::App(HINSTANCE hinstance) {
     this->haccel = nullptr;
     this->running = false;
     this->system = nullptr;
-    this->renderer = nullptr;
+    this->video = nullptr;
+    this->filter = nullptr;
+    this->filterCommand = 0;
+    this->frameQueue = new FrameQueue;
+    this->emulation = nullptr;
 }
 
 App::~App() {
-
+    delete emulation;
+    delete system;
+    delete video;
+    delete filter;
+    delete frameQueue;
 }
 
 void App::init() {
@@ -79,8 +93,10 @@ void App::init() {
         MessageBox(hwnd, TEXT("Failed to load accelerator"), TEXT("Warning"), MB_OK|MB_ICONWARNING);
     }
 
-    this->renderer = new D3D9Renderer(this);
-    this->renderer->init();
+    this->video = new D3D9Renderer(this);
+    if (!this->video->init()) {
+        MessageBox(hwnd, TEXT("Failed to initialise Direct3D 9"), TEXT("Warning"), MB_OK|MB_ICONWARNING);
+    }
 }
 
 void App::loop() {
@@ -94,11 +110,13 @@ void App::loop() {
                 DispatchMessage(&msg);
             }
         } else {
-            if (system != nullptr) {
-                system->tick();
+            // frames come from the emulation thread, this only shows the newest one; presenting
+            // waits for vertical sync, and with nothing new it waits for messages for a moment instead
+            if (frameQueue->acquire()) {
+                video->submit(frameQueue->getFrontBuffer());
+            } else {
+                MsgWaitForMultipleObjects(0, nullptr, FALSE, 1, QS_ALLINPUT);
             }
-
-            renderer->render();
         }
     }
 
@@ -106,7 +124,8 @@ void App::loop() {
 }
 
 void App::shutdown() {
-    renderer->shutdown();
+    stopEmulation();
+    video->shutdown();
     DestroyWindow(hwnd);
 }
 
@@ -141,21 +160,52 @@ LRESULT App::wndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 
                 case IDM_DUMPROM: {
                     if (system && system->getRom()) {
+                        stopEmulation();
                         system->getRom()->dump();
+                        startEmulation();
                     }
                     break;
                 }
 
                 case IDM_DUMPBUS: {
                     if (system && system->getBus()) {
+                        stopEmulation();
                         system->getBus()->dump();
+                        startEmulation();
+                    }
+                    break;
+                }
+
+                case IDM_TRACECPU: {
+                    if (system && system->getCpu()) {
+                        stopEmulation();
+                        Cpu *cpu = system->getCpu();
+                        if (cpu->isTracing()) {
+                            cpu->stopTrace();
+                        } else if (!cpu->startTrace("cpu.trace")) {
+                            MessageBox(hwnd, TEXT("Failed to open cpu.trace"), TEXT("Error"), MB_OK|MB_ICONERROR);
+                        }
+
+                        CheckMenuItem(GetMenu(hwnd), IDM_TRACECPU, MF_BYCOMMAND | (cpu->isTracing() ? MF_CHECKED : MF_UNCHECKED));
+                        startEmulation();
                     }
                     break;
                 }
 
+                case IDM_NTSCFILTER:
+                case IDM_SCALE2X:
+                case IDM_SCALE3X:
+                case IDM_XBR2X: {
+                    selectFilter(wmId);
+                    break;
+                }
+
                 case IDM_RESET: {
                     if (system) {
+                        stopEmulation();
                         system->reset();
+                        printf("Reset\n");
+                        startEmulation();
                     }
                     break;
                 }
@@ -192,23 +242,89 @@ void App::openFile() {
     ofn.hwndOwner = hwnd;
     ofn.lpstrFile = path;
     ofn.nMaxFile = MAX_PATH;
-    ofn.lpstrFilter = TEXT("iNES ROMs\0*.nes\0All files\0*.*\0");
+    ofn.lpstrFilter = TEXT("NES ROMs\0*.nes;*.gz;*.zip\0All files\0*.*\0");
     ofn.nFilterIndex = 1;
     ofn.lpstrTitle = TEXT("Select a ROM");
     ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST | OFN_NOCHANGEDIR;
 
     if (GetOpenFileName(&ofn)) {
+        stopEmulation();
+        delete emulation;
+        emulation = nullptr;
         if (system != nullptr) {
             delete system;
         }
 
         system = new System;
-        if (!system->loadRom(path)) {
+        CheckMenuItem(GetMenu(hwnd), IDM_TRACECPU, MF_BYCOMMAND | MF_UNCHECKED);
+        printf("Load %s\n", path);
+        const char *error = system->loadRom(path);
+        if (error) {
+            printf("Failed to load ROM: %s\n", error);
             MessageBox(hwnd, TEXT("Failed to load ROM"), TEXT("Error"), MB_OK|MB_ICONERROR);
         } else {
+            const Rom *rom = system->getRom();
+            if (rom->headerCorrected) {
+                printf("Header corrected from the database: mapper %d.%d\n", rom->mapperNumber, rom->submapper);
+            }
             setWindowTitle(path);
             system->start();
+            printf("Started\n");
+            emulation = new EmulationThread(system, frameQueue);
+            startEmulation();
+        }
+    }
+}
+
+// frames are filtered on this thread as they're presented, so the emulation carries on regardless
+void App::selectFilter(int command) {
+    video->setFilter(nullptr);
+    delete filter;
+    filter = nullptr;
+
+    if (command == filterCommand) {
+        filterCommand = 0;
+    } else {
+        switch (command) {
+            case IDM_NTSCFILTER: {
+                filter = new NtscFilter(3, 0);
+                break;
+            }
+
+            case IDM_SCALE2X: {
+                filter = new ScaleFilter(ScaleFilterType_Scale2x, 0);
+                break;
+            }
+
+            case IDM_SCALE3X: {
+                filter = new ScaleFilter(ScaleFilterType_Scale3x, 0);
+                break;
+            }
+
+            case IDM_XBR2X: {
+                filter = new ScaleFilter(ScaleFilterType_Xbr2x, 0);
+                break;
+            }
         }
+        filterCommand = command;
+        video->setFilter(filter);
+    }
+
+    static const int commands[] = { IDM_NTSCFILTER, IDM_SCALE2X, IDM_SCALE3X, IDM_XBR2X };
+    for (int item : commands) {
+        CheckMenuItem(GetMenu(hwnd), item, MF_BYCOMMAND | (item == filterCommand ? MF_CHECKED : MF_UNCHECKED));
+    }
+}
+
+void App::startEmulation() {
+    if (emulation != nullptr) {
+        emulation->start(NTSC_FRAMES_PER_SECOND);
+    }
+}
+
+void App::stopEmulation() {
+    if (emulation != nullptr) {
+        emulation->stop();
     }
 }
 
@@ -3,7 +3,10 @@
 #include "safewindows.h"
 
 class System;
-class D3D9Renderer;
+class VideoSink;
+class VideoFilter;
+class FrameQueue;
+class EmulationThread;
 
 class App {
 public:
@@ -24,13 +27,24 @@ public:
 private:
     void openFile();
 
+    // switches to the filter for a Video menu command, or back to none if it's already the one in use
+    void selectFilter(int command);
+
+    // anything that touches the System from the UI thread has to stop emulation around it
+    void startEmulation();
+    void stopEmulation();
+
     HWND hwnd;
     HINSTANCE hinstance;
     HACCEL haccel;
     bool running;
 
     System *system;
-    D3D9Renderer *renderer;
+    VideoSink *video;
+    VideoFilter *filter;
+    int filterCommand;
+    FrameQueue *frameQueue;
+    EmulationThread *emulation;
 };
 
 extern App *globalApp;
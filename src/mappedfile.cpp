@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <cstdint>
+#if defined(_WIN32)
+#include "safewindows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "mappedfile.h"
+
+MappedFile::MappedFile() {
+    this->data = nullptr;
+    this->size = 0;
+    this->mapped = false;
+    this->buffer = nullptr;
+#if defined(_WIN32)
+    this->file = INVALID_HANDLE_VALUE;
+    this->mapping = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+// an empty file can't be mapped, and some filesystems won't map at all, so those are read instead
+bool MappedFile::open(const char *path) {
+    close();
+
+    if (map(path)) {
+        return true;
+    }
+    return readAll(path);
+}
+
+void MappedFile::close() {
+    if (mapped) {
+#if defined(_WIN32)
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        munmap(const_cast<byte *>(data), size);
+#endif
+    }
+
+    delete[] buffer;
+    buffer = nullptr;
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+#if defined(_WIN32)
+bool MappedFile::map(const char *path) {
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(f, &length) || length.QuadPart == 0 || static_cast<unsigned long long>(length.QuadPart) > SIZE_MAX) {
+        CloseHandle(f);
+        return false;
+    }
+
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m == nullptr) {
+        CloseHandle(f);
+        return false;
+    }
+
+    void *view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+
+    file = f;
+    mapping = m;
+    data = static_cast<const byte *>(view);
+    size = static_cast<size_t>(length.QuadPart);
+    mapped = true;
+    return true;
+}
+#else
+bool MappedFile::map(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // the mapping holds its own reference to the file, the descriptor isn't needed after this
+    void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    data = static_cast<const byte *>(view);
+    size = static_cast<size_t>(info.st_size);
+    mapped = true;
+    return true;
+}
+#endif
+
+bool MappedFile::readAll(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0) {
+        fclose(f);
+        return false;
+    }
+    long length = ftell(f);
+    if (length < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return false;
+    }
+
+    buffer = new byte[length > 0 ? length : 1];
+    if (fread(buffer, 1, static_cast<size_t>(length), f) != static_cast<size_t>(length)) {
+        fclose(f);
+        delete[] buffer;
+        buffer = nullptr;
+        return false;
+    }
+    fclose(f);
+
+    data = buffer;
+    size = static_cast<size_t>(length);
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include "armadadef.h"
+
+// A whole file, read only. Mapped into memory where the platform allows, so only the parts that
+// are touched are ever read from disk, and pages of the same file are shared between every
+// instance that has it open. Otherwise it's read into a buffer in one go.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char *path);
+    void close();
+
+    const byte *getData() const { return this->data; }
+    size_t getSize() const { return this->size; }
+    bool isMapped() const { return this->mapped; }
+
+private:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool map(const char *path);
+    bool readAll(const char *path);
+
+    const byte *data;
+    size_t size;
+    bool mapped;
+    byte *buffer;
+#if defined(_WIN32)
+    // HANDLEs, kept as void * so Windows.h stays out of the header
+    void *file;
+    void *mapping;
+#endif
+};
+
+
@@ -1,5 +1,109 @@
+#include <cstring>
 #include "mapper.h"
+#include "rom.h"
+#include "system.h"
+#include "cpu.h"
+#include "cpubus.h"
+#include "ppu.h"
+#include "ppubus.h"
 
 Mapper::Mapper(Rom *rom) {
     this->rom = rom;
-}
\ No newline at end of file
+    this->system = rom->getSystem();
+    memset(this->prgRam, 0, sizeof(this->prgRam));
+
+    // until the mapper switches anything in, both windows start at bank 0
+    for (unsigned i = 0; i < PRG_BANK_COUNT; i++) {
+        this->prgBanks[i] = rom->prgRom + (rom->prgRomSize != 0 ? (i * PRG_BANK_SIZE) % rom->prgRomSize : 0);
+    }
+    for (unsigned i = 0; i < CHR_BANK_COUNT; i++) {
+        this->chrOffsets[i] = rom->chrRomSize != 0 ? (i * CHR_BANK_SIZE) % rom->chrRomSize : 0;
+        this->chrBanks[i] = rom->chrRom + this->chrOffsets[i];
+    }
+}
+
+void Mapper::writeChr(address addr, byte value) {
+    if (!rom->hasChrRam) {
+        return;
+    }
+
+    uint32_t offset = getChrOffset(addr);
+    rom->chrRam[offset] = value;
+    rom->chrCache.update(rom->chrRam, offset);
+}
+
+void Mapper::reset() {
+}
+
+void Mapper::writeRegister(address addr, byte value) {
+}
+
+void Mapper::clockScanline() {
+}
+
+void Mapper::saveState(MapperState *state) const {
+}
+
+void Mapper::loadState(const MapperState *state) {
+}
+
+void Mapper::mapPrg(address addr, unsigned size, int bank) {
+    unsigned count = rom->prgRomSize / size;
+    if (bank < 0) {
+        bank += count > 0 ? count : 1;
+    }
+
+    // worked out in 8 KiB units, so a window bigger than the whole ROM mirrors it
+    // Rom::load only takes whole banks, but a ROM with none would divide by zero below
+    unsigned total = rom->prgRomSize / PRG_BANK_SIZE;
+    if (total == 0) {
+        return;
+    }
+    unsigned first = (addr - 0x8000) / PRG_BANK_SIZE;
+    unsigned span = size / PRG_BANK_SIZE;
+    bool changed = false;
+
+    for (unsigned i = 0; i < span; i++) {
+        const byte *bank8k = rom->prgRom + ((bank * span + i) % total) * PRG_BANK_SIZE;
+        if (prgBanks[first + i] != bank8k) {
+            prgBanks[first + i] = bank8k;
+            changed = true;
+        }
+    }
+
+    // code decoded from the old bank is no longer what's there
+    if (changed) {
+        for (unsigned i = 0; i < span; i++) {
+            system->getBus()->setBank(static_cast<address>(addr + i * PRG_BANK_SIZE), PRG_BANK_SIZE, prgBanks[first + i]);
+        }
+        system->getCpu()->invalidateBlocks(addr, static_cast<address>(addr + size - 1));
+    }
+}
+
+void Mapper::mapChr(address addr, unsigned size, int bank) {
+    unsigned count = rom->chrRomSize / size;
+    if (bank < 0) {
+        bank += count > 0 ? count : 1;
+    }
+
+    unsigned total = rom->chrRomSize / CHR_BANK_SIZE;
+    if (total == 0) {
+        return;
+    }
+    unsigned first = addr / CHR_BANK_SIZE;
+    unsigned span = size / CHR_BANK_SIZE;
+
+    for (unsigned i = 0; i < span; i++) {
+        chrOffsets[first + i] = ((bank * span + i) % total) * CHR_BANK_SIZE;
+        chrBanks[first + i] = rom->chrRom + chrOffsets[first + i];
+        system->getPpu()->getBus()->setBank(static_cast<address>(addr + i * CHR_BANK_SIZE), CHR_BANK_SIZE, chrBanks[first + i]);
+    }
+}
+
+void Mapper::setMirroring(int mirroring) {
+    if (rom->mirroring == NametableMirroring_FourScreen) {
+        return;
+    }
+
+    system->getPpu()->getBus()->setMirroring(mirroring);
+}
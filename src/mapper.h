@@ -1,20 +1,86 @@
 #pragma once
 
+#include <cstdint>
 #include "armadadef.h"
 
 class Rom;
-class CpuBus;
+class System;
+struct MapperState;
 
+// the granularity of the bank tables, the smallest bank any supported mapper switches
+const unsigned PRG_BANK_SIZE = 0x2000;
+const unsigned CHR_BANK_SIZE = 0x400;
+const unsigned PRG_BANK_COUNT = 0x8000 / PRG_BANK_SIZE;
+const unsigned CHR_BANK_COUNT = 0x2000 / CHR_BANK_SIZE;
+
+// work RAM at $6000-$7FFF, and the pattern RAM carts without CHR ROM carry instead
+const unsigned PRG_RAM_SIZE = 0x2000;
+const unsigned CHR_RAM_SIZE = 0x2000;
+
+// Cartridge hardware. PRG and CHR are seen through tables of pointers to 8 KiB and 1 KiB banks,
+// which a mapper only touches when one of its registers is written. The CPU and PPU buses are
+// given the same pointers for their page tables, so a fetch never calls into the mapper at all.
 class Mapper {
 public:
     Mapper(Rom *rom);
     virtual ~Mapper() = default;
 
-    virtual byte readPrg(address addr) = 0;
-    virtual byte readChr(address addr) = 0;
+    // $8000-$FFFF
+    byte readPrg(address addr) const {
+        return this->prgBanks[(addr >> 13) & (PRG_BANK_COUNT - 1)][addr & (PRG_BANK_SIZE - 1)];
+    }
+
+    // $0000-$1FFF of the PPU bus
+    byte readChr(address addr) const {
+        return this->chrBanks[(addr >> 10) & (CHR_BANK_COUNT - 1)][addr & (CHR_BANK_SIZE - 1)];
+    }
+
+    // only does anything for carts with CHR RAM
+    void writeChr(address addr, byte value);
+
+    // where the pattern data the PPU sees at addr comes from in CHR, for looking it up in Rom::chrCache
+    uint32_t getChrOffset(address addr) const {
+        return this->chrOffsets[(addr >> 10) & (CHR_BANK_COUNT - 1)] + (addr & (CHR_BANK_SIZE - 1));
+    }
+
+    byte *getPrgRam() { return this->prgRam; }
+
+    // host memory for each 8 KiB slot of $8000-$FFFF and 1 KiB slot of $0000-$1FFF
+    const byte *getPrgBank(unsigned slot) const { return this->prgBanks[slot]; }
+    const byte *getChrBank(unsigned slot) const { return this->chrBanks[slot]; }
+
+    // puts the registers in their power-on state, once the buses are connected
+    virtual void reset();
+
+    // a CPU write to $8000-$FFFF, ignored by carts without registers
+    virtual void writeRegister(address addr, byte value);
+
+    // Mappers that count scanlines (MMC3) are clocked once per rendered line, and say how many
+    // more clocks it will take before they raise an IRQ, so the CPU can stop there. 0 is never.
+    virtual bool hasScanlineCounter() const { return false; }
+    virtual void clockScanline();
+    virtual unsigned getClocksUntilIrq() const { return 0; }
+
+    // mappers with bank registers keep them in the state, the default has nothing to save
+    virtual void saveState(MapperState *state) const;
+    virtual void loadState(const MapperState *state);
 
 protected:
-    Rom *rom;
-};
+    // Switches size bytes at addr to the given bank, counted in units of size, and installs it on
+    // the bus. Banks past the end wrap around, as the unused high bits of a register would on a
+    // smaller cart, and negative banks count back from the end, so -1 is the last.
+    void mapPrg(address addr, unsigned size, int bank);
+    void mapChr(address addr, unsigned size, int bank);
+
+    // one of NametableMirroring_*, ignored on carts wired for four-screen VRAM
+    void setMirroring(int mirroring);
 
+    Rom *rom;
+    System *system;
 
+private:
+    const byte *prgBanks[PRG_BANK_COUNT];
+    const byte *chrBanks[CHR_BANK_COUNT];
+    uint32_t chrOffsets[CHR_BANK_COUNT];
+    byte prgRam[PRG_RAM_SIZE];
+};
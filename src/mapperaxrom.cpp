@@ -0,0 +1,36 @@
+#include <cstring>
+#include "mapperaxrom.h"
+#include "ppubus.h"
+#include "savestate.h"
+
+MapperAxROM::MapperAxROM(Rom *rom)
+: Mapper(rom) {
+    this->bank = 0;
+}
+
+void MapperAxROM::reset() {
+    bank = 0;
+    applyBanks();
+}
+
+void MapperAxROM::writeRegister(address addr, byte value) {
+    bank = value;
+    applyBanks();
+}
+
+void MapperAxROM::applyBanks() {
+    mapPrg(0x8000, 0x8000, bank & 0x07);
+    mapChr(0x0000, 0x2000, 0);
+    setMirroring((bank & 0x10) ? NametableMirroring_SingleScreenHigh : NametableMirroring_SingleScreenLow);
+}
+
+// the one register is all there is
+void MapperAxROM::saveState(MapperState *state) const {
+    memset(state, 0, sizeof(MapperState));
+    state->data[0] = bank;
+}
+
+void MapperAxROM::loadState(const MapperState *state) {
+    bank = state->data[0];
+    applyBanks();
+}
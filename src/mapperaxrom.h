@@ -0,0 +1,23 @@
+#pragma once
+
+#include "mapper.h"
+
+// 32 KiB of PRG switched at once, and one-screen mirroring picked by the same register
+class MapperAxROM : public Mapper {
+public:
+    MapperAxROM(Rom *rom);
+    ~MapperAxROM() = default;
+
+    void reset() override;
+    void writeRegister(address addr, byte value) override;
+
+    void saveState(MapperState *state) const override;
+    void loadState(const MapperState *state) override;
+
+private:
+    void applyBanks();
+
+    byte bank;
+};
+
+
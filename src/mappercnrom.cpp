@@ -0,0 +1,34 @@
+#include <cstring>
+#include "mappercnrom.h"
+#include "savestate.h"
+
+MapperCNROM::MapperCNROM(Rom *rom)
+: Mapper(rom) {
+    this->bank = 0;
+}
+
+void MapperCNROM::reset() {
+    bank = 0;
+    applyBanks();
+}
+
+void MapperCNROM::writeRegister(address addr, byte value) {
+    bank = value;
+    applyBanks();
+}
+
+void MapperCNROM::applyBanks() {
+    mapPrg(0x8000, 0x8000, 0);
+    mapChr(0x0000, 0x2000, bank);
+}
+
+// the one register is all there is
+void MapperCNROM::saveState(MapperState *state) const {
+    memset(state, 0, sizeof(MapperState));
+    state->data[0] = bank;
+}
+
+void MapperCNROM::loadState(const MapperState *state) {
+    bank = state->data[0];
+    applyBanks();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "mapper.h"
+
+// fixed PRG, with the whole 8 KiB of CHR switched at once
+class MapperCNROM : public Mapper {
+public:
+    MapperCNROM(Rom *rom);
+    ~MapperCNROM() = default;
+
+    void reset() override;
+    void writeRegister(address addr, byte value) override;
+
+    void saveState(MapperState *state) const override;
+    void loadState(const MapperState *state) override;
+
+private:
+    void applyBanks();
+
+    byte bank;
+};
+
+
@@ -0,0 +1,144 @@
+#include <cstring>
+#include "mappermmc1.h"
+#include "rom.h"
+#include "ppubus.h"
+#include "savestate.h"
+
+// the shift register is empty when the marker bit has been shifted down to bit 0
+const byte MMC1_SHIFT_EMPTY = 0x10;
+// PRG mode 3, 16 KiB at $8000 with the last bank fixed at $C000
+const byte MMC1_CONTROL_RESET = 0x0C;
+
+struct MapperMMC1State {
+    byte shift;
+    byte control;
+    byte chrBank0;
+    byte chrBank1;
+    byte prgBank;
+};
+
+static_assert(sizeof(MapperMMC1State) <= MAPPER_STATE_SIZE, "MMC1 state doesn't fit");
+
+MapperMMC1::MapperMMC1(Rom *rom)
+: Mapper(rom) {
+    this->shift = MMC1_SHIFT_EMPTY;
+    this->control = MMC1_CONTROL_RESET;
+    this->chrBank0 = 0;
+    this->chrBank1 = 0;
+    this->prgBank = 0;
+}
+
+void MapperMMC1::reset() {
+    shift = MMC1_SHIFT_EMPTY;
+    control = MMC1_CONTROL_RESET;
+    chrBank0 = 0;
+    chrBank1 = 0;
+    prgBank = 0;
+    applyBanks();
+}
+
+void MapperMMC1::writeRegister(address addr, byte value) {
+    if (value & 0x80) {
+        shift = MMC1_SHIFT_EMPTY;
+        control |= MMC1_CONTROL_RESET;
+        applyBanks();
+        return;
+    }
+
+    bool full = (shift & 1) != 0;
+    shift = static_cast<byte>((shift >> 1) | ((value & 1) << 4));
+    if (!full) {
+        return;
+    }
+
+    // the fifth write picks the register from its address
+    switch ((addr >> 13) & 3) {
+        case 0: {
+            control = shift;
+            break;
+        }
+
+        case 1: {
+            chrBank0 = shift;
+            break;
+        }
+
+        case 2: {
+            chrBank1 = shift;
+            break;
+        }
+
+        case 3: {
+            prgBank = shift;
+            break;
+        }
+    }
+
+    shift = MMC1_SHIFT_EMPTY;
+    applyBanks();
+}
+
+void MapperMMC1::applyBanks() {
+    static const int mirroring[] = {
+        NametableMirroring_SingleScreenLow,
+        NametableMirroring_SingleScreenHigh,
+        NametableMirroring_Vertical,
+        NametableMirroring_Horizontal,
+    };
+    setMirroring(mirroring[control & 3]);
+
+    // 512 KiB carts (SUROM) pick which 256 KiB half is in with a CHR register bit
+    int outer = rom->prgRomSize > 0x40000 ? (chrBank0 & 0x10) : 0;
+    int bank = prgBank & 0x0F;
+
+    switch ((control >> 2) & 3) {
+        case 0:
+        case 1: {
+            mapPrg(0x8000, 0x8000, (outer | bank) >> 1);
+            break;
+        }
+
+        case 2: {
+            mapPrg(0x8000, 0x4000, outer);
+            mapPrg(0xC000, 0x4000, outer | bank);
+            break;
+        }
+
+        case 3: {
+            mapPrg(0x8000, 0x4000, outer | bank);
+            mapPrg(0xC000, 0x4000, outer | 0x0F);
+            break;
+        }
+    }
+
+    if (control & 0x10) {
+        mapChr(0x0000, 0x1000, chrBank0);
+        mapChr(0x1000, 0x1000, chrBank1);
+    } else {
+        mapChr(0x0000, 0x2000, chrBank0 >> 1);
+    }
+}
+
+void MapperMMC1::saveState(MapperState *state) const {
+    MapperMMC1State saved;
+    saved.shift = shift;
+    saved.control = control;
+    saved.chrBank0 = chrBank0;
+    saved.chrBank1 = chrBank1;
+    saved.prgBank = prgBank;
+
+    memset(state, 0, sizeof(MapperState));
+    memcpy(state->data, &saved, sizeof(saved));
+}
+
+void MapperMMC1::loadState(const MapperState *state) {
+    MapperMMC1State saved;
+    memcpy(&saved, state->data, sizeof(saved));
+
+    shift = saved.shift;
+    control = saved.control;
+    chrBank0 = saved.chrBank0;
+    chrBank1 = saved.chrBank1;
+    prgBank = saved.prgBank;
+    applyBanks();
+}
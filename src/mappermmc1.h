@@ -0,0 +1,27 @@
+#pragma once
+
+#include "mapper.h"
+
+// SxROM: registers loaded a bit at a time through a 5-bit shift register
+class MapperMMC1 : public Mapper {
+public:
+    MapperMMC1(Rom *rom);
+    ~MapperMMC1() = default;
+
+    void reset() override;
+    void writeRegister(address addr, byte value) override;
+
+    void saveState(MapperState *state) const override;
+    void loadState(const MapperState *state) override;
+
+private:
+    void applyBanks();
+
+    byte shift;
+    byte control;
+    byte chrBank0;
+    byte chrBank1;
+    byte prgBank;
+};
+
+
@@ -0,0 +1,183 @@
+#include <cstring>
+#include "mappermmc3.h"
+#include "rom.h"
+#include "system.h"
+#include "cpu.h"
+#include "ppubus.h"
+#include "savestate.h"
+
+enum {
+    Mmc3BankSelect_RegisterMask                 = 0x07,
+    // swaps the switchable bank at $8000 with the second-last bank fixed at $C000
+    Mmc3BankSelect_PrgMode                      = (1U << 6U),
+    // swaps the 2 KiB and 1 KiB CHR banks between the two pattern tables
+    Mmc3BankSelect_ChrInversion                 = (1U << 7U),
+};
+
+struct MapperMMC3State {
+    byte bankSelect;
+    byte banks[8];
+    byte mirroring;
+    byte irqLatch;
+    byte irqCounter;
+    byte irqReload;
+    byte irqEnabled;
+};
+
+static_assert(sizeof(MapperMMC3State) <= MAPPER_STATE_SIZE, "MMC3 state doesn't fit");
+
+MapperMMC3::MapperMMC3(Rom *rom)
+: Mapper(rom) {
+    this->bankSelect = 0;
+    memset(this->banks, 0, sizeof(this->banks));
+    this->mirroring = 0;
+    this->irqLatch = 0;
+    this->irqCounter = 0;
+    this->irqReload = false;
+    this->irqEnabled = false;
+}
+
+void MapperMMC3::reset() {
+    bankSelect = 0;
+    memset(banks, 0, sizeof(banks));
+    mirroring = 0;
+    irqLatch = 0;
+    irqCounter = 0;
+    irqReload = false;
+    irqEnabled = false;
+    setIrq(false);
+
+    // the registers are undefined at power on, but most carts' mirroring is what the header says
+    if (rom->mirroring == NametableMirroring_Horizontal) {
+        mirroring = 1;
+    }
+    applyBanks();
+}
+
+// registers sit in pairs, picked by bits 13-14 and whether the address is odd
+void MapperMMC3::writeRegister(address addr, byte value) {
+    bool odd = (addr & 1) != 0;
+
+    switch ((addr >> 13) & 3) {
+        case 0: {
+            if (odd) {
+                banks[bankSelect & Mmc3BankSelect_RegisterMask] = value;
+            } else {
+                bankSelect = value;
+            }
+            applyBanks();
+            break;
+        }
+
+        case 1: {
+            // the odd register write-protects PRG RAM, which nothing relies on being enforced
+            if (!odd) {
+                mirroring = value & 1;
+                applyBanks();
+            }
+            break;
+        }
+
+        case 2: {
+            if (odd) {
+                irqCounter = 0;
+                irqReload = true;
+            } else {
+                irqLatch = value;
+            }
+            break;
+        }
+
+        case 3: {
+            // disabling also acknowledges an IRQ already raised
+            irqEnabled = odd;
+            if (!odd) {
+                setIrq(false);
+            }
+            break;
+        }
+    }
+}
+
+void MapperMMC3::applyBanks() {
+    setMirroring(mirroring ? NametableMirroring_Horizontal : NametableMirroring_Vertical);
+
+    address low = (bankSelect & Mmc3BankSelect_PrgMode) ? 0xC000 : 0x8000;
+    address high = (bankSelect & Mmc3BankSelect_PrgMode) ? 0x8000 : 0xC000;
+    mapPrg(low, 0x2000, banks[6]);
+    mapPrg(0xA000, 0x2000, banks[7]);
+    mapPrg(high, 0x2000, -2);
+    mapPrg(0xE000, 0x2000, -1);
+
+    // R0 and R1 are 2 KiB banks that ignore their low bit
+    address invert = (bankSelect & Mmc3BankSelect_ChrInversion) ? 0x1000 : 0x0000;
+    mapChr(invert ^ 0x0000, 0x400, banks[0] & 0xFE);
+    mapChr(invert ^ 0x0400, 0x400, banks[0] | 0x01);
+    mapChr(invert ^ 0x0800, 0x400, banks[1] & 0xFE);
+    mapChr(invert ^ 0x0C00, 0x400, banks[1] | 0x01);
+    mapChr(invert ^ 0x1000, 0x400, banks[2]);
+    mapChr(invert ^ 0x1400, 0x400, banks[3]);
+    mapChr(invert ^ 0x1800, 0x400, banks[4]);
+    mapChr(invert ^ 0x1C00, 0x400, banks[5]);
+}
+
+// the counter is reloaded when it's run out or a reload was asked for, otherwise counted down,
+// and raises an IRQ whenever it ends up at 0
+void MapperMMC3::clockScanline() {
+    if (irqCounter == 0 || irqReload) {
+        irqCounter = irqLatch;
+        irqReload = false;
+    } else {
+        irqCounter--;
+    }
+
+    if (irqCounter == 0 && irqEnabled) {
+        setIrq(true);
+    }
+}
+
+unsigned MapperMMC3::getClocksUntilIrq() const {
+    if (!irqEnabled) {
+        return 0;
+    }
+
+    if (irqCounter > 0 && !irqReload) {
+        return irqCounter;
+    }
+
+    // a latch of 0 raises an IRQ on every clock
+    return irqLatch == 0 ? 1 : 1 + irqLatch;
+}
+
+void MapperMMC3::setIrq(bool asserted) {
+    system->getCpu()->setIrqLine(CpuIrqSource_Mapper, asserted);
+}
+
+void MapperMMC3::saveState(MapperState *state) const {
+    MapperMMC3State saved;
+    saved.bankSelect = bankSelect;
+    memcpy(saved.banks, banks, sizeof(banks));
+    saved.mirroring = mirroring;
+    saved.irqLatch = irqLatch;
+    saved.irqCounter = irqCounter;
+    saved.irqReload = irqReload;
+    saved.irqEnabled = irqEnabled;
+
+    memset(state, 0, sizeof(MapperState));
+    memcpy(state->data, &saved, sizeof(saved));
+}
+
+// the CPU keeps its own copy of the IRQ line in its state, so it isn't raised again here
+void MapperMMC3::loadState(const MapperState *state) {
+    MapperMMC3State saved;
+    memcpy(&saved, state->data, sizeof(saved));
+
+    bankSelect = saved.bankSelect;
+    memcpy(banks, saved.banks, sizeof(banks));
+    mirroring = saved.mirroring;
+    irqLatch = saved.irqLatch;
+    irqCounter = saved.irqCounter;
+    irqReload = saved.irqReload != 0;
+    irqEnabled = saved.irqEnabled != 0;
+    applyBanks();
+}
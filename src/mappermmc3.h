@@ -0,0 +1,35 @@
+#pragma once
+
+#include "mapper.h"
+
+// TxROM: 8 KiB PRG and 1/2 KiB CHR banks, and an IRQ counted down once per rendered scanline
+class MapperMMC3 : public Mapper {
+public:
+    MapperMMC3(Rom *rom);
+    ~MapperMMC3() = default;
+
+    void reset() override;
+    void writeRegister(address addr, byte value) override;
+
+    bool hasScanlineCounter() const override { return true; }
+    void clockScanline() override;
+    unsigned getClocksUntilIrq() const override;
+
+    void saveState(MapperState *state) const override;
+    void loadState(const MapperState *state) override;
+
+private:
+    void applyBanks();
+    void setIrq(bool asserted);
+
+    byte bankSelect;
+    byte banks[8];
+    byte mirroring;
+
+    byte irqLatch;
+    byte irqCounter;
+    bool irqReload;
+    bool irqEnabled;
+};
+
+
@@ -1,19 +1,8 @@
 #include "mappernrom.h"
-#include "rom.h"
 
+// a 16 KiB cart shows up twice
 MapperNROM::MapperNROM(Rom *rom)
 : Mapper(rom) {
-    this->oneBank = rom->prgRomSize == 0x4000;
+    mapPrg(0x8000, 0x8000, 0);
+    mapChr(0x0000, 0x2000, 0);
 }
-
-byte MapperNROM::readPrg(address addr) {
-    if (!oneBank) {
-        return this->rom->prgRom[addr];
-    } else {
-        return this->rom->prgRom[addr & 0x3FFF];
-    }
-}
-
-byte MapperNROM::readChr(address addr) {
-    return this->rom->chrRom[addr];
-}
\ No newline at end of file
@@ -2,16 +2,11 @@
 
 #include "mapper.h"
 
+// no bank switching, 16 or 32 KiB of PRG and 8 KiB of CHR
 class MapperNROM : public Mapper {
 public:
     MapperNROM(Rom *rom);
     ~MapperNROM() = default;
-
-    byte readPrg(address addr) override;
-    byte readChr(address addr) override;
-
-private:
-    bool oneBank;
 };
 
 
@@ -0,0 +1,35 @@
+#include <cstring>
+#include "mapperuxrom.h"
+#include "savestate.h"
+
+MapperUxROM::MapperUxROM(Rom *rom)
+: Mapper(rom) {
+    this->bank = 0;
+}
+
+void MapperUxROM::reset() {
+    bank = 0;
+    applyBanks();
+}
+
+void MapperUxROM::writeRegister(address addr, byte value) {
+    bank = value;
+    applyBanks();
+}
+
+void MapperUxROM::applyBanks() {
+    mapPrg(0x8000, 0x4000, bank);
+    mapPrg(0xC000, 0x4000, -1);
+    mapChr(0x0000, 0x2000, 0);
+}
+
+// the one register is all there is
+void MapperUxROM::saveState(MapperState *state) const {
+    memset(state, 0, sizeof(MapperState));
+    state->data[0] = bank;
+}
+
+void MapperUxROM::loadState(const MapperState *state) {
+    bank = state->data[0];
+    applyBanks();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "mapper.h"
+
+// 16 KiB of PRG switched in at $8000, with the last bank fixed at $C000
+class MapperUxROM : public Mapper {
+public:
+    MapperUxROM(Rom *rom);
+    ~MapperUxROM() = default;
+
+    void reset() override;
+    void writeRegister(address addr, byte value) override;
+
+    void saveState(MapperState *state) const override;
+    void loadState(const MapperState *state) override;
+
+private:
+    void applyBanks();
+
+    byte bank;
+};
+
+
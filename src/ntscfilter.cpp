@@ -0,0 +1,237 @@
+#include <cmath>
+#include <cstring>
+#include "ntscfilter.h"
+#include "rowpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NTSC_SSE2
+#include <emmintrin.h>
+#endif
+
+// samples of padding either side of a line, half a subcarrier cycle, so windows at the edges stay in bounds
+const unsigned NTSC_PADDING = NTSC_CYCLE / 2;
+const unsigned NTSC_PADDED_SAMPLES = NTSC_LINE_SAMPLES + NTSC_PADDING * 2;
+
+struct NtscFilter::Scratch {
+    // running totals of luma and both chroma products, one entry ahead of the samples
+    float y[NTSC_PADDED_SAMPLES + 1];
+    float i[NTSC_PADDED_SAMPLES + 1];
+    float q[NTSC_PADDED_SAMPLES + 1];
+    float signal[NTSC_PADDED_SAMPLES];
+    float modulatedI[NTSC_PADDED_SAMPLES];
+    float modulatedQ[NTSC_PADDED_SAMPLES];
+};
+
+// Output voltages of the 2C02, relative to sync, for the low and high half of the square wave
+// at each of the four brightness levels, from the nesdev wiki's measurements
+static const float SIGNAL_LOW[4] = { 0.350f, 0.518f, 0.962f, 1.550f };
+static const float SIGNAL_HIGH[4] = { 1.094f, 1.506f, 1.962f, 1.962f };
+static const float SIGNAL_BLACK = 0.518f;
+static const float SIGNAL_WHITE = 1.962f;
+static const float EMPHASIS_ATTENUATION = 0.746f;
+
+static bool isInColorPhase(unsigned color, unsigned phase) {
+    return (color + phase) % NTSC_CYCLE < 6;
+}
+
+// the signal for one pixel at one phase, normalised so black is 0 and white is 1
+static float getSignalLevel(unsigned pixel, unsigned phase) {
+    unsigned color = pixel & 0x0F;
+    unsigned level = (pixel >> 4) & 3;
+    unsigned emphasis = (pixel >> 6) & 7;
+
+    // colours 14 and 15 are forced to level 1
+    if (color > 13) {
+        level = 1;
+    }
+
+    float low = SIGNAL_LOW[level];
+    float high = SIGNAL_HIGH[level];
+    if (color == 0) {
+        low = high;
+    }
+    if (color > 12) {
+        high = low;
+    }
+
+    float signal = isInColorPhase(color, phase) ? high : low;
+
+    if (((emphasis & 1) && isInColorPhase(0, phase))
+        || ((emphasis & 2) && isInColorPhase(4, phase))
+        || ((emphasis & 4) && isInColorPhase(8, phase))) {
+        signal *= EMPHASIS_ATTENUATION;
+    }
+
+    return (signal - SIGNAL_BLACK) / (SIGNAL_WHITE - SIGNAL_BLACK);
+}
+
+NtscFilter::NtscFilter(unsigned scale, unsigned threads) {
+    this->width = PPU_WIDTH * scale;
+    this->output = new uint32_t[this->width * PPU_HEIGHT];
+    this->input = nullptr;
+    this->frameNumber = 0;
+
+    this->levels = new float[0x200][NTSC_CYCLE * 2];
+    for (unsigned pixel = 0; pixel < 0x200; pixel++) {
+        for (unsigned phase = 0; phase < NTSC_CYCLE * 2; phase++) {
+            this->levels[pixel][phase] = getSignalLevel(pixel, phase % NTSC_CYCLE);
+        }
+    }
+
+    // the TV takes its reference phase from the colour burst, four samples round from where the
+    // PPU's own cycle starts; the averaged products come out at half the chroma amplitude, hence the 2
+    const double pi = 3.14159265358979323846;
+    for (unsigned start = 0; start < 3; start++) {
+        this->carrierI[start] = new float[NTSC_PADDED_SAMPLES];
+        this->carrierQ[start] = new float[NTSC_PADDED_SAMPLES];
+        for (unsigned s = 0; s < NTSC_PADDED_SAMPLES; s++) {
+            unsigned phase = (start * 4 + s + 4 + NTSC_CYCLE - NTSC_PADDING) % NTSC_CYCLE;
+            this->carrierI[start][s] = static_cast<float>(2 * std::cos(pi * phase / 6));
+            this->carrierQ[start][s] = static_cast<float>(2 * std::sin(pi * phase / 6));
+        }
+    }
+
+    this->centers = new unsigned[this->width];
+    for (unsigned x = 0; x < this->width; x++) {
+        this->centers[x] = NTSC_PADDING + static_cast<unsigned>((x * 2 + 1) * NTSC_LINE_SAMPLES / (this->width * 2));
+    }
+
+    this->pool = new RowPool(threads);
+    this->scratch = new Scratch[this->pool->getThreadCount()];
+}
+
+NtscFilter::~NtscFilter() {
+    delete pool;
+    delete[] scratch;
+    delete[] centers;
+    for (unsigned start = 0; start < 3; start++) {
+        delete[] carrierI[start];
+        delete[] carrierQ[start];
+    }
+    delete[] levels;
+    delete[] output;
+}
+
+unsigned NtscFilter::getThreadCount() const {
+    return pool->getThreadCount();
+}
+
+const uint32_t *NtscFilter::apply(const uint16_t *pixels, unsigned frameNumber) {
+    this->input = pixels;
+    this->frameNumber = frameNumber;
+    pool->run(PPU_HEIGHT, filterRows, this);
+    return output;
+}
+
+void NtscFilter::filterRows(unsigned start, unsigned end, unsigned worker, void *userData) {
+    NtscFilter *filter = (NtscFilter *)userData;
+
+    for (unsigned y = start; y < end; y++) {
+        // 341 dots of 8 samples leaves each line 4 samples further round the cycle than the last,
+        // and the odd frame's skipped dot makes every other frame start somewhere else again
+        unsigned phase = (y + (filter->frameNumber & 1) * 2) % 3;
+        filter->filterLine(filter->input + y * PPU_WIDTH, filter->output + y * filter->width, phase,
+                           &filter->scratch[worker]);
+    }
+}
+
+void NtscFilter::filterLine(const uint16_t *in, uint32_t *out, unsigned phase, Scratch *scratch) {
+    // encode: each pixel's eight samples, carrying on round the cycle from the one before
+    float *signal = scratch->signal;
+    memset(signal, 0, NTSC_PADDING * sizeof(float));
+    memset(signal + NTSC_PADDING + NTSC_LINE_SAMPLES, 0, NTSC_PADDING * sizeof(float));
+
+    unsigned pixelPhase = phase * 4;
+    for (unsigned x = 0; x < PPU_WIDTH; x++) {
+        memcpy(signal + NTSC_PADDING + x * NTSC_SAMPLES_PER_PIXEL, &levels[in[x] & 0x1FF][pixelPhase],
+               NTSC_SAMPLES_PER_PIXEL * sizeof(float));
+        pixelPhase = (pixelPhase + NTSC_SAMPLES_PER_PIXEL) % NTSC_CYCLE;
+    }
+
+    // demodulate against the subcarrier
+    const float *cosine = carrierI[phase];
+    const float *sine = carrierQ[phase];
+    float *modulatedI = scratch->modulatedI;
+    float *modulatedQ = scratch->modulatedQ;
+    unsigned s = 0;
+
+#ifdef NTSC_SSE2
+    for (; s + 4 <= NTSC_PADDED_SAMPLES; s += 4) {
+        __m128 level = _mm_loadu_ps(signal + s);
+        _mm_storeu_ps(modulatedI + s, _mm_mul_ps(level, _mm_loadu_ps(cosine + s)));
+        _mm_storeu_ps(modulatedQ + s, _mm_mul_ps(level, _mm_loadu_ps(sine + s)));
+    }
+#endif
+    for (; s < NTSC_PADDED_SAMPLES; s++) {
+        modulatedI[s] = signal[s] * cosine[s];
+        modulatedQ[s] = signal[s] * sine[s];
+    }
+
+    // running totals, so each output pixel's window is a difference of two
+    float *sumY = scratch->y;
+    float *sumI = scratch->i;
+    float *sumQ = scratch->q;
+    sumY[0] = sumI[0] = sumQ[0] = 0;
+    for (s = 0; s < NTSC_PADDED_SAMPLES; s++) {
+        sumY[s + 1] = sumY[s] + signal[s];
+        sumI[s + 1] = sumI[s] + modulatedI[s];
+        sumQ[s + 1] = sumQ[s] + modulatedQ[s];
+    }
+
+    // decode: a cycle's average around the middle of each output pixel, then YIQ to RGB
+    const float scale = 1.0f / NTSC_CYCLE;
+    unsigned x = 0;
+
+#ifdef NTSC_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 full = _mm_set1_ps(255.0f);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000U));
+
+    for (; x + 4 <= width; x += 4) {
+        float yiq[3][4];
+        for (unsigned j = 0; j < 4; j++) {
+            unsigned center = centers[x + j];
+            unsigned first = center - NTSC_PADDING;
+            unsigned last = center + NTSC_PADDING;
+            yiq[0][j] = sumY[last] - sumY[first];
+            yiq[1][j] = sumI[last] - sumI[first];
+            yiq[2][j] = sumQ[last] - sumQ[first];
+        }
+
+        __m128 y = _mm_mul_ps(_mm_loadu_ps(yiq[0]), _mm_set1_ps(scale * 255.0f));
+        __m128 i = _mm_mul_ps(_mm_loadu_ps(yiq[1]), _mm_set1_ps(scale * 255.0f));
+        __m128 q = _mm_mul_ps(_mm_loadu_ps(yiq[2]), _mm_set1_ps(scale * 255.0f));
+
+        __m128 r = _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(i, _mm_set1_ps(0.946882f)), _mm_mul_ps(q, _mm_set1_ps(0.623557f))));
+        __m128 g = _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(i, _mm_set1_ps(-0.274788f)), _mm_mul_ps(q, _mm_set1_ps(-0.635691f))));
+        __m128 b = _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(i, _mm_set1_ps(-1.108545f)), _mm_mul_ps(q, _mm_set1_ps(1.709007f))));
+
+        __m128i red = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(r, zero), full));
+        __m128i green = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(g, zero), full));
+        __m128i blue = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(b, zero), full));
+
+        __m128i rgba = _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 8)), _mm_or_si128(_mm_slli_epi32(blue, 16), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), rgba);
+    }
+#endif
+
+    for (; x < width; x++) {
+        unsigned center = centers[x];
+        float y = (sumY[center + NTSC_PADDING] - sumY[center - NTSC_PADDING]) * scale * 255.0f;
+        float i = (sumI[center + NTSC_PADDING] - sumI[center - NTSC_PADDING]) * scale * 255.0f;
+        float q = (sumQ[center + NTSC_PADDING] - sumQ[center - NTSC_PADDING]) * scale * 255.0f;
+
+        float channels[3] = {
+            y + 0.946882f * i + 0.623557f * q,
+            y - 0.274788f * i - 0.635691f * q,
+            y - 1.108545f * i + 1.709007f * q,
+        };
+
+        uint32_t pixel = 0xFF000000U;
+        for (unsigned c = 0; c < 3; c++) {
+            float value = channels[c] < 0 ? 0 : (channels[c] > 255.0f ? 255.0f : channels[c]);
+            pixel |= static_cast<uint32_t>(value) << (c * 8);
+        }
+        out[x] = pixel;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include "videofilter.h"
+#include "ppu.h"
+
+class RowPool;
+
+// signal samples per PPU pixel, and the length of one colour subcarrier cycle in samples
+const unsigned NTSC_SAMPLES_PER_PIXEL = 8;
+const unsigned NTSC_CYCLE = 12;
+const unsigned NTSC_LINE_SAMPLES = PPU_WIDTH * NTSC_SAMPLES_PER_PIXEL;
+
+// Simulates the composite signal: every pixel is encoded as the PPU's square wave, eight samples
+// long, and decoded again by averaging each output pixel's surroundings over one subcarrier cycle,
+// giving the colour fringing and blur of a real TV. Lines are spread across a RowPool.
+class NtscFilter : public VideoFilter {
+public:
+    // scale is the output width in multiples of 256, usually 2 or 3; threads as for RowPool
+    NtscFilter(unsigned scale, unsigned threads);
+    ~NtscFilter();
+
+    unsigned getOutputWidth() const override { return this->width; }
+    unsigned getOutputHeight() const override { return PPU_HEIGHT; }
+
+    const uint32_t *apply(const uint16_t *pixels, unsigned frameNumber) override;
+
+    unsigned getThreadCount() const;
+
+private:
+    struct Scratch;
+
+    static void filterRows(unsigned start, unsigned end, unsigned worker, void *userData);
+    void filterLine(const uint16_t *in, uint32_t *out, unsigned phase, Scratch *scratch);
+
+    unsigned width;
+    uint32_t *output;
+
+    // signal level for every pixel value at every phase, written out twice so that any 8
+    // consecutive phases can be copied in one go
+    float (*levels)[NTSC_CYCLE * 2];
+    // the subcarrier for the length of a line, starting at each of the three phases a line can start on
+    float *carrierI[3];
+    float *carrierQ[3];
+    // the sample in the middle of each output pixel
+    unsigned *centers;
+
+    RowPool *pool;
+    Scratch *scratch;
+
+    // for the current apply()
+    const uint16_t *input;
+    unsigned frameNumber;
+};
@@ -0,0 +1,258 @@
+#include "pixelkernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// the 2C02 palette, 0xRRGGBB
+static const uint32_t ntscColors[64] = {
+    0x666666, 0x002A88, 0x1412A7, 0x3B00A4, 0x5C007E, 0x6E0040, 0x6C0600, 0x561D00,
+    0x333500, 0x0B4800, 0x005200, 0x004F08, 0x00404D, 0x000000, 0x000000, 0x000000,
+    0xADADAD, 0x155FD9, 0x4240FF, 0x7527FE, 0xA01ACC, 0xB71E7B, 0xB53120, 0x994E00,
+    0x6B6D00, 0x388700, 0x0C9300, 0x008F32, 0x007C8D, 0x000000, 0x000000, 0x000000,
+    0xFFFEFF, 0x64B0FF, 0x9290FF, 0xC676FF, 0xF36AFF, 0xFE6ECC, 0xFE8170, 0xEA9E22,
+    0xBCBE00, 0x88D800, 0x5CE430, 0x45E082, 0x48CDDE, 0x4F4F4F, 0x000000, 0x000000,
+    0xFFFEFF, 0xC0DFFF, 0xD3D2FF, 0xE8C8FF, 0xFBC2FF, 0xFEC4EA, 0xFECCC5, 0xF7D8A5,
+    0xE4E594, 0xCFEF96, 0xBDF4AB, 0xB3F3CC, 0xB5EBF2, 0xB8B8B8, 0x000000, 0x000000,
+};
+
+void buildRgbaPalette(uint32_t *palette) {
+    for (unsigned i = 0; i < RGBA_PALETTE_SIZE; i++) {
+        uint32_t color = ntscColors[i & 0x3F];
+        unsigned emphasis = i >> 6;
+        unsigned channels[3] = { (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF };
+
+        // each emphasis bit darkens the other two channels
+        for (unsigned bit = 0; bit < 3; bit++) {
+            if (!(emphasis & (1U << bit))) {
+                continue;
+            }
+            for (unsigned channel = 0; channel < 3; channel++) {
+                if (channel != bit) {
+                    channels[channel] = channels[channel] * 209 / 256;
+                }
+            }
+        }
+
+        // bytes in R, G, B, A order
+        palette[i] = channels[0] | (channels[1] << 8) | (channels[2] << 16) | 0xFF000000U;
+    }
+}
+
+// the reference everything else has to match
+static bool compositeScalar(const byte *background, const byte *sprites, const byte *palette,
+                            uint16_t *out, unsigned count, byte colorMask, uint16_t emphasis) {
+    bool hit = false;
+
+    for (unsigned i = 0; i < count; i++) {
+        byte bg = background[i];
+        byte sprite = sprites[i];
+        byte index = bg;
+
+        if (sprite & 3) {
+            if ((sprite & 0x20) && bg) {
+                hit = true;
+            }
+            if (!bg || !(sprite & 0x10)) {
+                index = 0x10 | (sprite & 0x0F);
+            }
+        }
+
+        out[i] = (palette[index] & colorMask) | emphasis;
+    }
+
+    return hit;
+}
+
+static void convertRgbaScalar(const uint16_t *pixels, uint32_t *out, unsigned count, const uint32_t *palette) {
+    for (unsigned i = 0; i < count; i++) {
+        out[i] = palette[pixels[i] & (RGBA_PALETTE_SIZE - 1)];
+    }
+}
+
+#ifdef PIXEL_KERNELS_X86
+
+// SSE2 has no byte shuffle to look the palette up with, so it only does the priority mux in
+// vectors and reads the palette through a table with the mask and emphasis already applied
+static bool compositeSse2(const byte *background, const byte *sprites, const byte *palette,
+                          uint16_t *out, unsigned count, byte colorMask, uint16_t emphasis) {
+    uint16_t colors[0x20];
+    for (unsigned i = 0; i < 0x20; i++) {
+        colors[i] = (palette[i] & colorMask) | emphasis;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i valueMask = _mm_set1_epi8(0x03);
+    const __m128i colorBits = _mm_set1_epi8(0x0F);
+    const __m128i spriteBase = _mm_set1_epi8(0x10);
+    const __m128i behindBit = _mm_set1_epi8(0x10);
+    const __m128i zeroBit = _mm_set1_epi8(0x20);
+    int hits = 0;
+    unsigned i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i bg = _mm_loadu_si128(reinterpret_cast<const __m128i *>(background + i));
+        __m128i sprite = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sprites + i));
+
+        __m128i bgOpaque = _mm_xor_si128(_mm_cmpeq_epi8(bg, zero), _mm_set1_epi8(-1));
+        __m128i spriteClear = _mm_cmpeq_epi8(_mm_and_si128(sprite, valueMask), zero);
+        __m128i behind = _mm_cmpeq_epi8(_mm_and_si128(sprite, behindBit), behindBit);
+        __m128i zeroSprite = _mm_cmpeq_epi8(_mm_and_si128(sprite, zeroBit), zeroBit);
+
+        // a sprite pixel is never set to sprite 0 without also being opaque
+        hits |= _mm_movemask_epi8(_mm_and_si128(zeroSprite, bgOpaque));
+
+        __m128i keepBg = _mm_or_si128(spriteClear, _mm_and_si128(bgOpaque, behind));
+        __m128i spriteIndex = _mm_or_si128(spriteBase, _mm_and_si128(sprite, colorBits));
+        __m128i index = _mm_or_si128(_mm_and_si128(keepBg, bg), _mm_andnot_si128(keepBg, spriteIndex));
+
+        alignas(16) byte indexes[16];
+        _mm_store_si128(reinterpret_cast<__m128i *>(indexes), index);
+        for (unsigned j = 0; j < 16; j++) {
+            out[i + j] = colors[indexes[j]];
+        }
+    }
+
+    bool hit = compositeScalar(background + i, sprites + i, palette, out + i, count - i, colorMask, emphasis);
+    return hits != 0 || hit;
+}
+
+static TARGET_AVX2 bool compositeAvx2(const byte *background, const byte *sprites, const byte *palette,
+                                      uint16_t *out, unsigned count, byte colorMask, uint16_t emphasis) {
+    // the palette fits in two shuffle tables, with the colour mask already applied
+    alignas(16) byte colors[0x20];
+    for (unsigned i = 0; i < 0x20; i++) {
+        colors[i] = palette[i] & colorMask;
+    }
+    const __m256i colorsLow = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(colors)));
+    const __m256i colorsHigh = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(colors + 16)));
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i valueMask = _mm256_set1_epi8(0x03);
+    const __m256i colorBits = _mm256_set1_epi8(0x0F);
+    const __m256i highHalf = _mm256_set1_epi8(0x10);
+    const __m256i zeroBit = _mm256_set1_epi8(0x20);
+    const __m256i emphasisBits = _mm256_set1_epi16(static_cast<short>(emphasis));
+    int hits = 0;
+    unsigned i = 0;
+
+    for (; i + 32 <= count; i += 32) {
+        __m256i bg = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(background + i));
+        __m256i sprite = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sprites + i));
+
+        __m256i bgClear = _mm256_cmpeq_epi8(bg, zero);
+        __m256i spriteClear = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, valueMask), zero);
+        __m256i behind = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, highHalf), highHalf);
+        __m256i zeroSprite = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, zeroBit), zeroBit);
+
+        hits |= _mm256_movemask_epi8(_mm256_andnot_si256(bgClear, zeroSprite));
+
+        __m256i keepBg = _mm256_or_si256(spriteClear, _mm256_andnot_si256(bgClear, behind));
+        __m256i spriteIndex = _mm256_or_si256(highHalf, _mm256_and_si256(sprite, colorBits));
+        __m256i index = _mm256_blendv_epi8(spriteIndex, bg, keepBg);
+
+        // the shuffle only looks at the low 4 bits, bit 4 picks which half of the palette
+        __m256i useHigh = _mm256_cmpeq_epi8(_mm256_and_si256(index, highHalf), highHalf);
+        __m256i color = _mm256_blendv_epi8(_mm256_shuffle_epi8(colorsLow, index),
+                                           _mm256_shuffle_epi8(colorsHigh, index), useHigh);
+
+        __m256i low = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(color));
+        __m256i high = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(color, 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_or_si256(low, emphasisBits));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + 16), _mm256_or_si256(high, emphasisBits));
+    }
+
+    bool hit = compositeScalar(background + i, sprites + i, palette, out + i, count - i, colorMask, emphasis);
+    return hits != 0 || hit;
+}
+
+static TARGET_AVX2 void convertRgbaAvx2(const uint16_t *pixels, uint32_t *out, unsigned count, const uint32_t *palette) {
+    const __m256i indexMask = _mm256_set1_epi32(RGBA_PALETTE_SIZE - 1);
+    const int *table = reinterpret_cast<const int *>(palette);
+    unsigned i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i));
+        __m256i index = _mm256_and_si256(_mm256_cvtepu16_epi32(packed), indexMask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_i32gather_epi32(table, index, 4));
+    }
+
+    convertRgbaScalar(pixels + i, out + i, count - i, palette);
+}
+
+static bool isSupported(int level) {
+    if (level == PixelKernelLevel_Scalar) {
+        return true;
+    }
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx2 = false;
+    if (osxsave && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse2 = __builtin_cpu_supports("sse2") != 0;
+    bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+
+    if (level == PixelKernelLevel_Sse2) {
+        return sse2;
+    }
+    return avx2;
+}
+
+#else
+
+static bool isSupported(int level) {
+    return level == PixelKernelLevel_Scalar;
+}
+
+#endif
+
+static const PixelKernels kernels[PixelKernelLevel_Count] = {
+    { "scalar", compositeScalar, convertRgbaScalar },
+#ifdef PIXEL_KERNELS_X86
+    { "sse2", compositeSse2, convertRgbaScalar },
+    { "avx2", compositeAvx2, convertRgbaAvx2 },
+#else
+    { "sse2", nullptr, nullptr },
+    { "avx2", nullptr, nullptr },
+#endif
+};
+
+const PixelKernels *getPixelKernels(int level) {
+    if (level < 0 || level >= PixelKernelLevel_Count || !isSupported(level)) {
+        return nullptr;
+    }
+    return &kernels[level];
+}
+
+static const PixelKernels *findBestKernels() {
+    for (int level = PixelKernelLevel_Count - 1; level > PixelKernelLevel_Scalar; level--) {
+        if (isSupported(level)) {
+            return &kernels[level];
+        }
+    }
+    return &kernels[PixelKernelLevel_Scalar];
+}
+
+const PixelKernels *getPixelKernels() {
+    static const PixelKernels *best = findBestKernels();
+    return best;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include "armadadef.h"
+
+// Combines a run of background and sprite pixels into framebuffer pixels.
+// background: 0 where transparent, otherwise colour | palette << 2, as an index into palette RAM
+// sprites: bits 0-1 colour, 2-3 palette, 4 behind background, 5 from sprite 0
+// Returns whether an opaque sprite 0 pixel landed on an opaque background pixel.
+typedef bool (*CompositeCallback)(const byte *background, const byte *sprites, const byte *palette,
+                                  uint16_t *out, unsigned count, byte colorMask, uint16_t emphasis);
+
+// framebuffer pixels to 32-bit RGBA, through a palette covering every colour and emphasis combination
+typedef void (*ConvertRgbaCallback)(const uint16_t *pixels, uint32_t *out, unsigned count, const uint32_t *palette);
+
+enum {
+    PixelKernelLevel_Scalar,
+    PixelKernelLevel_Sse2,
+    PixelKernelLevel_Avx2,
+
+    PixelKernelLevel_Count,
+};
+
+struct PixelKernels {
+    const char *name;
+    CompositeCallback composite;
+    ConvertRgbaCallback convertToRgba;
+};
+
+const unsigned RGBA_PALETTE_SIZE = 512;
+
+// the fastest set the CPU supports, picked the first time it's asked for
+const PixelKernels *getPixelKernels();
+
+// a specific set, or nullptr if the CPU doesn't support it
+const PixelKernels *getPixelKernels(int level);
+
+// the 2C02 colours, with every combination of the emphasis bits applied
+void buildRgbaPalette(uint32_t *palette);
@@ -1,12 +1,608 @@
 #include <cstring>
 #include "ppu.h"
+#include "ppubus.h"
 #include "system.h"
+#include "cpu.h"
+#include "savestate.h"
+#include "mapper.h"
+#include "chrcache.h"
+#include "pixelkernels.h"
+
+const unsigned SCANLINE_POST_RENDER = 240;
+const unsigned SCANLINE_VBLANK = 241;
+const unsigned SCANLINE_PRE_RENDER = 261;
+
+// dot counts at which something happens, counted after the dot has been run
+const unsigned DOT_FLAGS = 2;
+const unsigned DOT_VISIBLE_END = 258;
+// where MMC3 sees the rise of PPU A12 with backgrounds at $0000 and sprites at $1000
+const unsigned DOT_SCANLINE_COUNTER = 261;
+
+// what the pattern tables read as with no cartridge in
+static const byte emptyPatternRow[8] = { 0 };
+
+// palette entries 0x10/0x14/0x18/0x1C are the same memory as 0x00/0x04/0x08/0x0C
+static unsigned getPaletteIndex(address addr) {
+    unsigned index = addr & 0x1F;
+    if ((index & 0x13) == 0x10) {
+        index &= ~0x10U;
+    }
+    return index;
+}
+
+// four independent lanes, so the multiplies overlap instead of waiting on each other
+uint64_t hashScanline(const uint16_t *row) {
+    const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+    uint64_t lanes[4] = { 1, 2, 3, 4 };
+
+    for (unsigned i = 0; i < PPU_WIDTH; i += 16) {
+        uint64_t words[4];
+        memcpy(words, row + i, sizeof(words));
+        for (unsigned lane = 0; lane < 4; lane++) {
+            lanes[lane] = (lanes[lane] ^ words[lane]) * prime;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    uint64_t hash = lanes[0];
+    for (unsigned lane = 1; lane < 4; lane++) {
+        hash = (hash ^ lanes[lane]) * prime;
+    }
+    return hash ^ (hash >> 32);
+}
 
 Ppu::Ppu(System *system) {
     this->system = system;
+    this->bus = new PpuBus(system);
+    this->mapper = nullptr;
+    this->chrCache = nullptr;
+    this->kernels = getPixelKernels();
+    this->countScanlines = false;
     memset(&this->registers, 0, sizeof(PpuRegisters));
+
+    this->scanline = 0;
+    this->dot = 0;
+    this->frameCount = 0;
+    this->oddFrame = false;
+
+    this->v = 0;
+    this->t = 0;
+    this->x = 0;
+    this->w = false;
+    this->readBuffer = 0;
+    this->openBus = 0;
+
+    memset(this->oam, 0, sizeof(this->oam));
+    memset(this->palette, 0, sizeof(this->palette));
+
+    this->framebuffer = new uint16_t[PPU_WIDTH * PPU_HEIGHT];
+    memset(this->framebuffer, 0, PPU_WIDTH * PPU_HEIGHT * sizeof(uint16_t));
+    for (unsigned y = 0; y < PPU_HEIGHT; y++) {
+        this->rowHashes[y] = hashScanline(this->framebuffer + y * PPU_WIDTH);
+    }
+
+    startScanline();
 }
 
 Ppu::~Ppu() {
+    delete[] framebuffer;
+    delete bus;
+}
+
+void Ppu::setCartridge(Mapper *mapper, const ChrCache *chrCache) {
+    this->mapper = mapper;
+    this->chrCache = chrCache;
+    this->countScanlines = mapper != nullptr && mapper->hasScanlineCounter();
+}
+
+const byte *Ppu::getPatternRow(address addr, bool flipped) {
+    if (mapper == nullptr) {
+        return emptyPatternRow;
+    }
+
+    uint32_t offset = mapper->getChrOffset(addr);
+    return flipped ? chrCache->getFlippedRow(offset) : chrCache->getRow(offset);
+}
+
+void Ppu::step() {
+    run(1);
+}
+
+void Ppu::run(unsigned dots) {
+    while (dots > 0) {
+        unsigned next;
+        if (dot < DOT_FLAGS && (scanline == SCANLINE_VBLANK || scanline == SCANLINE_PRE_RENDER)) {
+            next = DOT_FLAGS;
+        } else if (dot < DOT_VISIBLE_END && (scanline < SCANLINE_POST_RENDER || scanline == SCANLINE_PRE_RENDER)) {
+            next = DOT_VISIBLE_END;
+        } else if (countScanlines && dot < DOT_SCANLINE_COUNTER && (scanline < SCANLINE_POST_RENDER || scanline == SCANLINE_PRE_RENDER)) {
+            next = DOT_SCANLINE_COUNTER;
+        } else {
+            next = getScanlineLength();
+        }
+
+        unsigned advance = next > dot ? next - dot : 0;
+        if (advance > dots) {
+            dot += dots;
+            return;
+        }
+
+        dot += advance;
+        dots -= advance;
+
+        if (next == DOT_FLAGS) {
+            if (scanline == SCANLINE_VBLANK) {
+                registers.ppustatus |= PpuStatus_VerticalBlank;
+                if (registers.ppuctrl & PpuCtrl_GenerateNmi) {
+                    system->getCpu()->generateNmi();
+                }
+            } else {
+                registers.ppustatus &= ~(PpuStatus_VerticalBlank | PpuStatus_SpriteZeroHit | PpuStatus_SpriteOverflow);
+            }
+        } else if (next == DOT_VISIBLE_END) {
+            finishVisibleDots();
+        } else if (next == DOT_SCANLINE_COUNTER) {
+            if (isRenderingEnabled()) {
+                mapper->clockScanline();
+            }
+        } else {
+            dot = 0;
+            if (++scanline == PPU_SCANLINES_PER_FRAME) {
+                scanline = 0;
+                frameCount++;
+                oddFrame = !oddFrame;
+            }
+            startScanline();
+        }
+    }
+}
+
+unsigned Ppu::getDotsUntilFrameEnd() const {
+    if (scanline == SCANLINE_PRE_RENDER) {
+        return getScanlineLength() - dot;
+    }
+    return (PPU_DOTS_PER_SCANLINE - dot) + (SCANLINE_PRE_RENDER - 1 - scanline) * PPU_DOTS_PER_SCANLINE + getPreRenderLength();
+}
+
+unsigned Ppu::getDotsUntilVblank() const {
+    if (scanline < SCANLINE_VBLANK || (scanline == SCANLINE_VBLANK && dot < DOT_FLAGS)) {
+        return (SCANLINE_VBLANK - scanline) * PPU_DOTS_PER_SCANLINE + DOT_FLAGS - dot;
+    }
+    return getDotsUntilFrameEnd() + SCANLINE_VBLANK * PPU_DOTS_PER_SCANLINE + DOT_FLAGS;
+}
+
+// future frames' pre-render lines are taken as the short one, so odd and even frames needn't be tracked
+unsigned Ppu::getDotsUntilScanlineClock(unsigned clocks) const {
+    if (!countScanlines || clocks == 0 || !isRenderingEnabled()) {
+        return 0;
+    }
+
+    unsigned dots = 0;
+    unsigned line = scanline;
+    unsigned at = dot;
+    bool first = true;
+
+    for (;;) {
+        if (at < DOT_SCANLINE_COUNTER && (line < SCANLINE_POST_RENDER || line == SCANLINE_PRE_RENDER)) {
+            dots += DOT_SCANLINE_COUNTER - at;
+            at = DOT_SCANLINE_COUNTER;
+            if (--clocks == 0) {
+                return dots;
+            }
+        }
+
+        unsigned length = PPU_DOTS_PER_SCANLINE;
+        if (first) {
+            length = getScanlineLength();
+        } else if (line == SCANLINE_PRE_RENDER) {
+            length = PPU_DOTS_PER_SCANLINE - 1;
+        }
+
+        dots += length - at;
+        at = 0;
+        first = false;
+        line = (line + 1) % PPU_SCANLINES_PER_FRAME;
+    }
+}
+
+bool Ppu::isRenderingEnabled() const {
+    return (registers.ppumask & (PpuMask_ShowBackground | PpuMask_ShowSprites)) != 0;
+}
+
+// the pre-render line skips its last dot on odd frames while rendering
+unsigned Ppu::getPreRenderLength() const {
+    if (oddFrame && isRenderingEnabled()) {
+        return PPU_DOTS_PER_SCANLINE - 1;
+    }
+    return PPU_DOTS_PER_SCANLINE;
+}
+
+unsigned Ppu::getScanlineLength() const {
+    return scanline == SCANLINE_PRE_RENDER ? getPreRenderLength() : PPU_DOTS_PER_SCANLINE;
+}
+
+// dots 256 and 257: the last pixel, then the scroll updates for the next line
+void Ppu::finishVisibleDots() {
+    if (scanline < SCANLINE_POST_RENDER) {
+        renderPixels(PPU_WIDTH);
+        rowHashes[scanline] = hashScanline(framebuffer + scanline * PPU_WIDTH);
+    }
+
+    if (!isRenderingEnabled()) {
+        return;
+    }
+
+    // increment vertical position
+    if ((v & 0x7000) != 0x7000) {
+        v += 0x1000;
+    } else {
+        v &= ~0x7000;
+        unsigned coarseY = (v & 0x03E0) >> 5;
+        if (coarseY == 29) {
+            coarseY = 0;
+            v ^= 0x0800;
+        } else if (coarseY == 31) {
+            coarseY = 0;
+        } else {
+            coarseY++;
+        }
+        v = (v & ~0x03E0) | (coarseY << 5);
+    }
+
+    // copy horizontal position from t
+    v = (v & ~0x041F) | (t & 0x041F);
+
+    // the pre-render line also copies the vertical position, during dots 280-304
+    if (scanline == SCANLINE_PRE_RENDER) {
+        v = (v & ~0x7BE0) | (t & 0x7BE0);
+    }
+}
+
+void Ppu::startScanline() {
+    renderedX = 0;
+    spritesEvaluated = false;
+    setScrollBase(0);
+}
+
+// the horizontal scroll in v and x applies from pixel x onwards
+void Ppu::setScrollBase(unsigned x) {
+    scrollBaseX = x;
+    scrollBase = (((v >> 10) & 1) << 8) | ((v & 0x1F) << 3) | this->x;
+}
+
+void Ppu::catchUp() {
+    if (scanline < SCANLINE_POST_RENDER && dot > 1) {
+        renderPixels(dot - 1 < PPU_WIDTH ? dot - 1 : PPU_WIDTH);
+    }
+}
+
+void Ppu::renderPixels(unsigned end) {
+    if (end <= renderedX) {
+        return;
+    }
+
+    uint16_t *out = framebuffer + scanline * PPU_WIDTH;
+    byte mask = registers.ppumask;
+    byte colorMask = (mask & PpuMask_Grayscale) ? 0x30 : 0x3F;
+    uint16_t emphasis = static_cast<uint16_t>((mask >> PpuMask_EmphasisShift) << PPU_EMPHASIS_SHIFT);
+
+    if (!isRenderingEnabled()) {
+        uint16_t backdrop = (palette[0] & colorMask) | emphasis;
+        for (unsigned px = renderedX; px < end; px++) {
+            out[px] = backdrop;
+        }
+        renderedX = end;
+        return;
+    }
+
+    if (!spritesEvaluated) {
+        evaluateSprites();
+    }
+
+    bool showBackground = (mask & PpuMask_ShowBackground) != 0;
+    bool showSprites = (mask & PpuMask_ShowSprites) != 0;
+    unsigned backgroundStart = (mask & PpuMask_ShowBackgroundLeft) ? 0 : 8;
+    unsigned spriteStart = (mask & PpuMask_ShowSpritesLeft) ? 0 : 8;
+
+    byte background[PPU_WIDTH];
+    memset(background + renderedX, 0, end - renderedX);
+
+    if (showBackground) {
+        address patternTable = (registers.ppuctrl & PpuCtrl_BackgroundPatternTable) ? 0x1000 : 0x0000;
+        unsigned fineY = (v >> 12) & 7;
+        unsigned coarseY = (v >> 5) & 0x1F;
+        unsigned nametableY = (v >> 11) & 1;
+
+        // the tile is only fetched again once the scroll position moves into the next one
+        unsigned tile = ~0U;
+        const byte *pattern = emptyPatternRow;
+        byte attribute = 0;
+
+        for (unsigned px = renderedX > backgroundStart ? renderedX : backgroundStart; px < end; px++) {
+            unsigned scroll = (scrollBase + px - scrollBaseX) & 0x1FF;
+            unsigned tileX = scroll >> 3;
+
+            if (tileX != tile) {
+                unsigned coarseX = tileX & 0x1F;
+                address nametable = 0x2000 | (nametableY << 11) | ((tileX >> 5) << 10);
+                byte index = bus->readNametable(nametable | (coarseY << 5) | coarseX);
+                byte attributes = bus->readNametable(nametable | 0x3C0 | ((coarseY >> 2) << 3) | (coarseX >> 2));
+                attribute = (attributes >> (((coarseY & 2) << 1) | (coarseX & 2))) & 3;
+
+                pattern = getPatternRow(patternTable | (index << 4) | fineY, false);
+                tile = tileX;
+            }
+
+            byte value = pattern[scroll & 7];
+            if (value) {
+                background[px] = value | (attribute << 2);
+            }
+        }
+    }
+
+    // sprites hidden by PPUMASK are cleared out of a copy, so the kernel only ever sees what's visible
+    const byte *sprites = spriteLine;
+    byte clippedSprites[PPU_WIDTH];
+    if (!showSprites || renderedX < spriteStart) {
+        memcpy(clippedSprites + renderedX, spriteLine + renderedX, end - renderedX);
+        unsigned clipEnd = showSprites ? (spriteStart < end ? spriteStart : end) : end;
+        memset(clippedSprites + renderedX, 0, clipEnd - renderedX);
+        sprites = clippedSprites;
+    }
+
+    if (kernels->composite(background + renderedX, sprites + renderedX, palette, out + renderedX,
+                           end - renderedX, colorMask, emphasis)) {
+        registers.ppustatus |= PpuStatus_SpriteZeroHit;
+    }
+
+    renderedX = end;
+}
+
+// finds the first 8 sprites on the current line and draws them into spriteLine
+void Ppu::evaluateSprites() {
+    spritesEvaluated = true;
+    memset(spriteLine, 0, sizeof(spriteLine));
+
+    bool tall = (registers.ppuctrl & PpuCtrl_TallSprites) != 0;
+    int height = tall ? 16 : 8;
+    address patternTable = (registers.ppuctrl & PpuCtrl_SpritePatternTable) ? 0x1000 : 0x0000;
+    unsigned found = 0;
+
+    for (unsigned i = 0; i < 64; i++) {
+        const byte *sprite = &oam[i * 4];
+
+        // sprites are evaluated a line early, so they appear one line below their Y
+        int row = static_cast<int>(scanline) - 1 - sprite[0];
+        if (row < 0 || row >= height) {
+            continue;
+        }
+
+        if (found == 8) {
+            registers.ppustatus |= PpuStatus_SpriteOverflow;
+            break;
+        }
+        found++;
+
+        byte index = sprite[1];
+        byte attributes = sprite[2];
+        if (attributes & 0x80) {
+            row = height - 1 - row;
+        }
+
+        address pattern;
+        if (tall) {
+            pattern = ((index & 1) << 12) | ((index & 0xFE) << 4) | ((row & 8) << 1) | (row & 7);
+        } else {
+            pattern = patternTable | (index << 4) | row;
+        }
+
+        const byte *patternRow = getPatternRow(pattern, (attributes & 0x40) != 0);
+
+        for (unsigned column = 0; column < 8; column++) {
+            unsigned px = sprite[3] + column;
+            if (px >= PPU_WIDTH) {
+                break;
+            }
+
+            // lower OAM indexes win, even when they end up behind the background
+            if (spriteLine[px] & 3) {
+                continue;
+            }
+
+            byte value = patternRow[column];
+            if (!value) {
+                continue;
+            }
+
+            // sprite 0 can't hit on the last pixel, so it isn't marked there
+            bool zero = i == 0 && px != PPU_WIDTH - 1;
+            spriteLine[px] = value | ((attributes & 3) << 2) | ((attributes & 0x20) ? 0x10 : 0) | (zero ? 0x20 : 0);
+        }
+    }
+}
+
+byte Ppu::readRegister(address reg) {
+    catchUp();
+
+    switch (reg & 7) {
+        case 2: {
+            openBus = (registers.ppustatus & 0xE0) | (openBus & 0x1F);
+            registers.ppustatus &= ~PpuStatus_VerticalBlank;
+            w = false;
+            break;
+        }
+
+        case 4: {
+            openBus = oam[registers.oamaddr];
+            break;
+        }
+
+        case 7: {
+            address addr = v & 0x3FFF;
+            if (addr < 0x3F00) {
+                // reads outside the palette come from a buffer filled by the previous read
+                openBus = readBuffer;
+                readBuffer = readVram(addr);
+            } else {
+                openBus = (readVram(addr) & 0x3F) | (openBus & 0xC0);
+                readBuffer = readVram(addr - 0x1000);
+            }
+            v += (registers.ppuctrl & PpuCtrl_Increment32) ? 32 : 1;
+            break;
+        }
+    }
+
+    return openBus;
+}
+
+void Ppu::writeRegister(address reg, byte value) {
+    catchUp();
+    openBus = value;
+
+    switch (reg & 7) {
+        case 0: {
+            bool nmiEnabled = (registers.ppuctrl & PpuCtrl_GenerateNmi) != 0;
+            registers.ppuctrl = value;
+            t = (t & 0xF3FF) | ((value & PpuCtrl_NametableMask) << 10);
+
+            // turning NMIs on during vertical blank raises one straight away
+            if (!nmiEnabled && (value & PpuCtrl_GenerateNmi) && (registers.ppustatus & PpuStatus_VerticalBlank)) {
+                system->getCpu()->generateNmi();
+            }
+            break;
+        }
+
+        case 1: {
+            registers.ppumask = value;
+            break;
+        }
+
+        case 3: {
+            registers.oamaddr = value;
+            break;
+        }
+
+        case 4: {
+            registers.oamdata = value;
+            oam[registers.oamaddr++] = value;
+            break;
+        }
+
+        case 5: {
+            registers.ppuscroll = value;
+            if (!w) {
+                t = (t & 0xFFE0) | (value >> 3);
+                x = value & 7;
+
+                // fine X takes effect straight away, even partway through a line
+                if (renderedX > 0 && renderedX < PPU_WIDTH) {
+                    unsigned scroll = (scrollBase + renderedX - scrollBaseX) & 0x1FF;
+                    scrollBaseX = renderedX;
+                    scrollBase = (scroll & ~7U) | x;
+                } else if (renderedX == 0) {
+                    setScrollBase(0);
+                }
+            } else {
+                t = (t & 0x8C1F) | ((value & 0xF8) << 2) | ((value & 7) << 12);
+            }
+            w = !w;
+            break;
+        }
+
+        case 6: {
+            registers.ppuaddr = value;
+            if (!w) {
+                t = (t & 0x00FF) | ((value & 0x3F) << 8);
+            } else {
+                t = (t & 0xFF00) | value;
+                v = t;
+                if (renderedX < PPU_WIDTH) {
+                    setScrollBase(renderedX);
+                }
+            }
+            w = !w;
+            break;
+        }
+
+        case 7: {
+            registers.ppudata = value;
+            writeVram(v & 0x3FFF, value);
+            v += (registers.ppuctrl & PpuCtrl_Increment32) ? 32 : 1;
+            break;
+        }
+    }
+}
+
+// the 256 bytes written to $4014's page, starting at OAMADDR and wrapping around
+void Ppu::writeOamDma(const byte *data) {
+    catchUp();
+
+    for (unsigned i = 0; i < sizeof(oam); i++) {
+        oam[(registers.oamaddr + i) & 0xFF] = data[i];
+    }
+}
+
+byte Ppu::readVram(address addr) {
+    if (addr >= 0x3F00) {
+        return palette[getPaletteIndex(addr)];
+    }
+    return bus->read(addr);
+}
+
+void Ppu::writeVram(address addr, byte value) {
+    if (addr >= 0x3F00) {
+        palette[getPaletteIndex(addr)] = value & 0x3F;
+        return;
+    }
+    bus->write(addr, value);
+}
+
+void Ppu::saveState(PpuState *state) const {
+    state->registers = registers;
+    state->v = v;
+    state->t = t;
+    state->x = x;
+    state->w = w;
+    state->readBuffer = readBuffer;
+    state->openBus = openBus;
+    state->scanline = static_cast<uint16_t>(scanline);
+    state->dot = static_cast<uint16_t>(dot);
+    state->renderedX = static_cast<uint16_t>(renderedX);
+    state->scrollBaseX = static_cast<uint16_t>(scrollBaseX);
+    state->scrollBase = static_cast<uint16_t>(scrollBase);
+    state->oddFrame = oddFrame;
+    state->padding = 0;
+    state->frameCount = frameCount;
+    memcpy(state->oam, oam, sizeof(oam));
+    memcpy(state->palette, palette, sizeof(palette));
+    for (unsigned i = 0; i < NAMETABLE_COUNT; i++) {
+        state->nametablePages[i] = static_cast<byte>(bus->getNametablePage(i));
+    }
+    memcpy(state->ram, bus->getRam(), PPU_RAM_SIZE);
+}
+
+void Ppu::loadState(const PpuState *state) {
+    registers = state->registers;
+    v = state->v;
+    t = state->t;
+    x = state->x;
+    w = state->w != 0;
+    readBuffer = state->readBuffer;
+    openBus = state->openBus;
+    scanline = state->scanline;
+    dot = state->dot;
+    renderedX = state->renderedX;
+    scrollBaseX = state->scrollBaseX;
+    scrollBase = state->scrollBase;
+    oddFrame = state->oddFrame != 0;
+    frameCount = state->frameCount;
+    memcpy(oam, state->oam, sizeof(oam));
+    memcpy(palette, state->palette, sizeof(palette));
+    for (unsigned i = 0; i < NAMETABLE_COUNT; i++) {
+        bus->setNametablePage(i, state->nametablePages[i] & (NAMETABLE_COUNT - 1));
+    }
+    memcpy(bus->getRam(), state->ram, PPU_RAM_SIZE);
 
+    // sprites are found again for whatever is left of the line
+    spritesEvaluated = false;
 }
@@ -1,8 +1,26 @@
 #pragma once
 
+#include <cstdint>
 #include "armadadef.h"
 
 class System;
+class PpuBus;
+class Mapper;
+class ChrCache;
+struct PixelKernels;
+struct PpuState;
+
+const unsigned PPU_WIDTH = 256;
+const unsigned PPU_HEIGHT = 240;
+const unsigned PPU_DOTS_PER_SCANLINE = 341;
+const unsigned PPU_SCANLINES_PER_FRAME = 262;
+const double NTSC_FRAMES_PER_SECOND = 60.0988;
+
+// framebuffer pixels are a 6-bit palette colour with the 3 emphasis bits from PPUMASK above it
+const unsigned PPU_EMPHASIS_SHIFT = 6;
+
+// a 64-bit hash of one framebuffer row, for spotting rows that haven't changed since an earlier frame
+uint64_t hashScanline(const uint16_t *row);
 
 struct PpuRegisters {
     byte ppuctrl;
@@ -15,17 +33,123 @@ struct PpuRegisters {
     byte ppudata;
 };
 
+enum {
+    PpuCtrl_NametableMask                       = 0x03,
+    PpuCtrl_Increment32                         = (1U << 2U),
+    PpuCtrl_SpritePatternTable                  = (1U << 3U),
+    PpuCtrl_BackgroundPatternTable              = (1U << 4U),
+    PpuCtrl_TallSprites                         = (1U << 5U),
+    PpuCtrl_GenerateNmi                         = (1U << 7U),
+};
+
+enum {
+    PpuMask_Grayscale                           = (1U << 0U),
+    PpuMask_ShowBackgroundLeft                  = (1U << 1U),
+    PpuMask_ShowSpritesLeft                     = (1U << 2U),
+    PpuMask_ShowBackground                      = (1U << 3U),
+    PpuMask_ShowSprites                         = (1U << 4U),
+    PpuMask_EmphasisShift                       = 5,
+};
+
+enum {
+    PpuStatus_SpriteOverflow                    = (1U << 5U),
+    PpuStatus_SpriteZeroHit                     = (1U << 6U),
+    PpuStatus_VerticalBlank                     = (1U << 7U),
+};
+
+// Renders a whole scanline at a time. A register access partway through a visible line first draws
+// the pixels up to that point, so mid-line effects still land where they should, while lines that
+// nothing touches are drawn in one pass.
 class Ppu {
 public:
     Ppu(System *system);
     ~Ppu();
 
+    // pattern data is read straight from the decoded CHR, not through the bus
+    void setCartridge(Mapper *mapper, const ChrCache *chrCache);
+
+    // defaults to the fastest the CPU supports
+    void setPixelKernels(const PixelKernels *kernels) { this->kernels = kernels; }
+
     void step();
+    void run(unsigned dots);
+
+    byte readRegister(address reg);
+    void writeRegister(address reg, byte value);
+    void writeOamDma(const byte *data);
+
+    void saveState(PpuState *state) const;
+    void loadState(const PpuState *state);
+
+    PpuBus *getBus() const { return this->bus; }
+    const uint16_t *getFramebuffer() const { return this->framebuffer; }
+    // hashScanline of each framebuffer row, taken as the row is finished
+    const uint64_t *getRowHashes() const { return this->rowHashes; }
+    unsigned getFrameCount() const { return this->frameCount; }
+    unsigned getScanline() const { return this->scanline; }
+    unsigned getDot() const { return this->dot; }
+
+    // dots left until the PPU wraps around to the first scanline of the next frame
+    unsigned getDotsUntilFrameEnd() const;
+    // dots left until vertical blank starts, which is when an NMI would be raised
+    unsigned getDotsUntilVblank() const;
+    // dots left until the mapper's scanline counter has been clocked that many more times, if
+    // rendering stays as it is, or 0 if it isn't being clocked. May come early, never late.
+    unsigned getDotsUntilScanlineClock(unsigned clocks) const;
+
+    // draws the current line up to where the PPU has got to, before anything changes how it looks
+    void catchUp();
 
     PpuRegisters registers;
 
 private:
+    bool isRenderingEnabled() const;
+    unsigned getPreRenderLength() const;
+    unsigned getScanlineLength() const;
+    void finishVisibleDots();
+    void startScanline();
+
+    void renderPixels(unsigned end);
+    void evaluateSprites();
+    void setScrollBase(unsigned x);
+    const byte *getPatternRow(address addr, bool flipped);
+
+    byte readVram(address addr);
+    void writeVram(address addr, byte value);
+
     System *system;
-};
+    PpuBus *bus;
+    Mapper *mapper;
+    const ChrCache *chrCache;
+    const PixelKernels *kernels;
+    bool countScanlines;
+
+    unsigned scanline;
+    unsigned dot;
+    unsigned frameCount;
+    bool oddFrame;
+
+    // loopy's names for the internal scroll registers
+    uint16_t v;
+    uint16_t t;
+    byte x;
+    bool w;
 
+    byte readBuffer;
+    byte openBus;
 
+    byte oam[0x100];
+    byte palette[0x20];
+
+    // current scanline, as far as it's been drawn
+    unsigned renderedX;
+    // horizontal scroll position, in pixels over both nametables, of pixel scrollBaseX
+    unsigned scrollBaseX;
+    unsigned scrollBase;
+    bool spritesEvaluated;
+    // per pixel: bits 0-1 colour, 2-3 palette, 4 behind background, 5 from sprite 0
+    byte spriteLine[PPU_WIDTH];
+
+    uint16_t *framebuffer;
+    uint64_t rowHashes[PPU_HEIGHT];
+};
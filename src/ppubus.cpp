@@ -1,12 +1,74 @@
+#include <cstring>
 #include "ppubus.h"
+#include "mapper.h"
+#include "savestate.h"
+
+static byte readCartridgeChrCallback(address addr, void *userData);
+static bool writeCartridgeChrCallback(address addr, byte value, void *userData);
+static byte readNametableCallback(address addr, void *userData);
+static bool writeNametableCallback(address addr, byte value, void *userData);
 
 PpuBus::PpuBus(System *system) : Bus() {
     this->system = system;
-    this->ram = new byte[0x800];
+    this->ram = new byte[PPU_RAM_SIZE];
+    memset(this->ram, 0, PPU_RAM_SIZE);
+
+    setMirroring(NametableMirroring_Horizontal);
 
-    mapMemory(0x2000, 0x2FFF, ram, 0x0800);
+    // 0x3000-0x3EFF mirrors the nametables, 0x3F00 and up is palette memory kept by the PPU
+    mapCallback(0x2000, 0x3EFF, readNametableCallback, writeNametableCallback, this);
 }
 
 PpuBus::~PpuBus() {
     delete[] ram;
-}
\ No newline at end of file
+}
+
+// only reached for pages the mapper has left without a bank
+byte readCartridgeChrCallback(address addr, void *userData) {
+    Mapper *mapper = (Mapper *)userData;
+    return mapper->readChr(addr);
+}
+
+// dropped unless the cart has CHR RAM
+bool writeCartridgeChrCallback(address addr, byte value, void *userData) {
+    Mapper *mapper = (Mapper *)userData;
+    mapper->writeChr(addr, value);
+    return true;
+}
+
+void PpuBus::setCartridgeMapper(Mapper *mapper) {
+    mapBanked(0x0000, 0x1FFF, readCartridgeChrCallback, writeCartridgeChrCallback, mapper);
+    for (unsigned i = 0; i < CHR_BANK_COUNT; i++) {
+        setBank(static_cast<address>(i * CHR_BANK_SIZE), CHR_BANK_SIZE, mapper->getChrBank(i));
+    }
+}
+
+byte readNametableCallback(address addr, void *userData) {
+    PpuBus *bus = (PpuBus *)userData;
+    return bus->readNametable(addr);
+}
+
+bool writeNametableCallback(address addr, byte value, void *userData) {
+    PpuBus *bus = (PpuBus *)userData;
+    bus->writeNametable(addr, value);
+    return true;
+}
+
+void PpuBus::setMirroring(int mirroring) {
+    static const unsigned layouts[][NAMETABLE_COUNT] = {
+        { 0, 0, 1, 1 }, // horizontal
+        { 0, 1, 0, 1 }, // vertical
+        { 0, 0, 0, 0 }, // single screen, low
+        { 1, 1, 1, 1 }, // single screen, high
+        { 0, 1, 2, 3 }, // four screen
+    };
+
+    for (unsigned i = 0; i < NAMETABLE_COUNT; i++) {
+        setNametablePage(i, layouts[mirroring][i]);
+    }
+}
+
+void PpuBus::setNametablePage(unsigned nametable, unsigned page) {
+    nametablePages[nametable] = page;
+    nametables[nametable] = ram + page * NAMETABLE_SIZE;
+}
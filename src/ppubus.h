@@ -5,6 +5,18 @@
 class System;
 class Mapper;
 
+enum {
+    NametableMirroring_Horizontal,
+    NametableMirroring_Vertical,
+    NametableMirroring_SingleScreenLow,
+    NametableMirroring_SingleScreenHigh,
+    // the cartridge brings another 2 KiB, so every nametable is its own
+    NametableMirroring_FourScreen,
+};
+
+const unsigned NAMETABLE_SIZE = 0x400;
+const unsigned NAMETABLE_COUNT = 4;
+
 class PpuBus : public Bus {
 public:
     PpuBus(System *system);
@@ -12,10 +24,25 @@ public:
 
     void setCartridgeMapper(Mapper *mapper);
 
+    void setMirroring(int mirroring);
+    // points one of the four nametables at a 1 KiB page of VRAM, for mappers that control mirroring
+    void setNametablePage(unsigned nametable, unsigned page);
+    unsigned getNametablePage(unsigned nametable) const { return this->nametablePages[nametable]; }
+
+    // 0x2000-0x3EFF, without going through the bus
+    byte readNametable(address addr) const {
+        return this->nametables[(addr >> 10) & 3][addr & (NAMETABLE_SIZE - 1)];
+    }
+    void writeNametable(address addr, byte value) {
+        this->nametables[(addr >> 10) & 3][addr & (NAMETABLE_SIZE - 1)] = value;
+    }
+
+    byte *getRam() const { return this->ram; }
+
 private:
     System *system;
 
     byte *ram;
+    byte *nametables[NAMETABLE_COUNT];
+    unsigned nametablePages[NAMETABLE_COUNT];
 };
-
-
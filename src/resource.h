@@ -12,3 +12,8 @@
 #define IDM_DUMPROM                             40002
 #define IDM_DUMPBUS                             40003
 #define IDM_RESET                               40004
+#define IDM_TRACECPU                            40005
+#define IDM_NTSCFILTER                          40006
+#define IDM_SCALE2X                             40007
+#define IDM_SCALE3X                             40008
+#define IDM_XBR2X                               40009
@@ -0,0 +1,268 @@
+#include <cstring>
+#include <chrono>
+#include "rewind.h"
+
+// shorter runs of unchanged bytes are cheaper to copy as part of the changed bytes around them
+const unsigned REWIND_MIN_ZERO_RUN = 4;
+const unsigned REWIND_MAX_RUN = 0xFFFF;
+
+RewindBuffer::RewindBuffer(size_t capacity, unsigned keyframeInterval, unsigned maxFrames)
+: head(0), tail(0), running(true) {
+    // enough that a keyframe always fits, even while the previous one is still being kept
+    if (capacity < 4 * sizeof(SystemState)) {
+        capacity = 4 * sizeof(SystemState);
+    }
+
+    this->pending = new SystemState[PENDING_CAPACITY];
+    this->havePrevious = false;
+    this->sinceKeyframe = 0;
+    this->scratch = new byte[2 * sizeof(SystemState) + 16];
+
+    this->data = new byte[capacity];
+    this->capacity = capacity;
+    this->writeOffset = 0;
+    this->usedBytes = 0;
+    this->keyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+    this->maxFrames = maxFrames > 0 ? maxFrames : 1;
+    this->entries = new RewindEntry[this->maxFrames];
+    this->first = 0;
+    this->count = 0;
+
+    compressor = std::thread(&RewindBuffer::compress, this);
+}
+
+RewindBuffer::~RewindBuffer() {
+    running = false;
+    compressor.join();
+
+    delete[] entries;
+    delete[] data;
+    delete[] scratch;
+    delete[] pending;
+}
+
+void RewindBuffer::push(const SystemState &state) {
+    unsigned h = head.load(std::memory_order_relaxed);
+
+    // the compressor has fallen a whole queue behind, wait for it rather than lose a frame
+    while (h - tail.load(std::memory_order_acquire) >= PENDING_CAPACITY) {
+        std::this_thread::yield();
+    }
+
+    pending[h % PENDING_CAPACITY] = state;
+    head.store(h + 1, std::memory_order_release);
+}
+
+void RewindBuffer::flush() {
+    while (tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+    }
+}
+
+bool RewindBuffer::pop(SystemState *state) {
+    flush();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (count == 0) {
+        return false;
+    }
+
+    decodeNewest(state);
+
+    RewindEntry *newest = &entries[(first + count - 1) % maxFrames];
+    usedBytes -= newest->length;
+    writeOffset = newest->offset;
+    count--;
+
+    // the next state pushed is a delta against whatever is now the newest
+    havePrevious = count > 0;
+    sinceKeyframe = havePrevious ? decodeNewest(&previous) : 0;
+
+    return true;
+}
+
+unsigned RewindBuffer::getFrameCount() {
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
+
+size_t RewindBuffer::getUsedBytes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return usedBytes;
+}
+
+void RewindBuffer::compress() {
+    unsigned t = tail.load(std::memory_order_relaxed);
+
+    while (true) {
+        bool stopping = !running.load(std::memory_order_acquire);
+        unsigned h = head.load(std::memory_order_acquire);
+
+        if (t == h) {
+            if (stopping) {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        store(pending[t % PENDING_CAPACITY]);
+        t++;
+        tail.store(t, std::memory_order_release);
+    }
+}
+
+void RewindBuffer::store(const SystemState &state) {
+    bool keyframe = !havePrevious || sinceKeyframe + 1 >= keyframeInterval;
+    size_t length = encode(state, keyframe ? nullptr : &previous, scratch);
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    while (true) {
+        if (count == maxFrames) {
+            dropOldest();
+        }
+
+        // what's left at the end is too short, and anything there is older than what's at the start
+        if (writeOffset + length > capacity) {
+            while (count > 0 && entries[first].offset >= writeOffset) {
+                dropOldest();
+            }
+            writeOffset = 0;
+        }
+
+        while (count > 0 && entries[first].offset < writeOffset + length
+               && entries[first].offset + entries[first].length > writeOffset) {
+            dropOldest();
+        }
+
+        // a delta is useless once the state it's against has been dropped
+        if (keyframe || count > 0) {
+            break;
+        }
+
+        keyframe = true;
+        length = encode(state, nullptr, scratch);
+    }
+
+    memcpy(data + writeOffset, scratch, length);
+
+    RewindEntry *entry = &entries[(first + count) % maxFrames];
+    entry->offset = writeOffset;
+    entry->length = length;
+    entry->keyframe = keyframe;
+    count++;
+
+    writeOffset += length;
+    usedBytes += length;
+
+    previous = state;
+    havePrevious = true;
+    sinceKeyframe = keyframe ? 0 : sinceKeyframe + 1;
+}
+
+// drops the oldest keyframe along with the deltas that depend on it
+void RewindBuffer::dropOldest() {
+    do {
+        usedBytes -= entries[first].length;
+        first = (first + 1) % maxFrames;
+        count--;
+    } while (count > 0 && !entries[first].keyframe);
+}
+
+// Encodes the XOR of state and reference, or the state itself when there's no reference,
+// as runs of unchanged bytes, each followed by a run of XORed bytes:
+// u16 unchanged length, u16 changed length, changed bytes
+size_t RewindBuffer::encode(const SystemState &state, const SystemState *reference, byte *out) {
+    const byte *current = (const byte *)&state;
+    const byte *base = (const byte *)reference;
+    const size_t size = sizeof(SystemState);
+
+#define DIFF(i) (base ? current[i] ^ base[i] : current[i])
+
+    size_t i = 0;
+    size_t length = 0;
+
+    while (i < size) {
+        unsigned unchanged = 0;
+        while (i < size && DIFF(i) == 0 && unchanged < REWIND_MAX_RUN) {
+            unchanged++;
+            i++;
+        }
+
+        size_t start = i;
+        unsigned changed = 0;
+        while (i < size && changed < REWIND_MAX_RUN) {
+            if (DIFF(i) == 0) {
+                unsigned run = 0;
+                while (i + run < size && run < REWIND_MIN_ZERO_RUN && DIFF(i + run) == 0) {
+                    run++;
+                }
+
+                if (run == REWIND_MIN_ZERO_RUN || i + run == size) {
+                    break;
+                }
+            }
+
+            changed++;
+            i++;
+        }
+
+        out[length++] = unchanged & 0xFF;
+        out[length++] = (unchanged >> 8) & 0xFF;
+        out[length++] = changed & 0xFF;
+        out[length++] = (changed >> 8) & 0xFF;
+
+        for (unsigned j = 0; j < changed; j++) {
+            out[length++] = DIFF(start + j);
+        }
+    }
+
+#undef DIFF
+
+    return length;
+}
+
+// applies an entry on top of the state before it, or on top of nothing for a keyframe
+void RewindBuffer::decode(const RewindEntry &entry, SystemState *state) {
+    byte *current = (byte *)state;
+    const byte *in = data + entry.offset;
+    const byte *end = in + entry.length;
+    size_t i = 0;
+
+    if (entry.keyframe) {
+        memset(state, 0, sizeof(SystemState));
+    }
+
+    while (in < end) {
+        unsigned unchanged = in[0] | (in[1] << 8);
+        unsigned changed = in[2] | (in[3] << 8);
+        in += 4;
+
+        i += unchanged;
+        for (unsigned j = 0; j < changed; j++) {
+            current[i++] ^= *in++;
+        }
+    }
+}
+
+// rebuilds the newest state from its keyframe, and returns how many deltas that took
+unsigned RewindBuffer::decodeNewest(SystemState *state) {
+    unsigned newest = (first + count - 1) % maxFrames;
+    unsigned index = newest;
+    unsigned distance = 0;
+
+    while (!entries[index].keyframe) {
+        index = (index + maxFrames - 1) % maxFrames;
+        distance++;
+    }
+
+    decode(entries[index], state);
+    while (index != newest) {
+        index = (index + 1) % maxFrames;
+        decode(entries[index], state);
+    }
+
+    return distance;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "armadadef.h"
+#include "savestate.h"
+
+// where a compressed state lives in the ring, and whether it can be decoded on its own
+struct RewindEntry {
+    size_t offset;
+    size_t length;
+    bool keyframe;
+};
+
+// Keeps the most recent states within a fixed amount of memory. Every keyframeInterval-th state
+// is stored whole, and the rest as the XOR against the state before them, run-length encoded.
+// push() only copies the state into a queue, the compression happens on a background thread.
+class RewindBuffer {
+public:
+    RewindBuffer(size_t capacity, unsigned keyframeInterval = 60, unsigned maxFrames = 60 * 60 * 10);
+    ~RewindBuffer();
+
+    void push(const SystemState &state);
+
+    // waits for every state pushed so far to be compressed
+    void flush();
+
+    // removes the newest state and returns it, waiting for anything still queued to be compressed
+    bool pop(SystemState *state);
+
+    unsigned getFrameCount();
+    size_t getUsedBytes();
+    size_t getCapacity() const { return this->capacity; }
+
+private:
+    void compress();
+    void store(const SystemState &state);
+    void dropOldest();
+    size_t encode(const SystemState &state, const SystemState *reference, byte *out);
+    void decode(const RewindEntry &entry, SystemState *state);
+    unsigned decodeNewest(SystemState *state);
+
+    static const unsigned PENDING_CAPACITY = 16;
+
+    // only touched by push() and the compressor
+    SystemState *pending;
+    std::atomic<unsigned> head;     // next state to be written by push()
+    std::atomic<unsigned> tail;     // next state to be compressed
+    std::atomic<bool> running;
+    std::thread compressor;
+
+    // only touched by the compressor, or by pop() once the queue is empty
+    SystemState previous;
+    bool havePrevious;
+    unsigned sinceKeyframe;
+    byte *scratch;
+
+    std::mutex lock;
+    byte *data;
+    size_t capacity;
+    size_t writeOffset;
+    size_t usedBytes;
+    unsigned keyframeInterval;
+    RewindEntry *entries;
+    unsigned maxFrames;
+    unsigned first;
+    unsigned count;
+};
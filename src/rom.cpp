@@ -4,6 +4,14 @@
 #include "system.h"
 #include "mapper.h"
 #include "mappernrom.h"
+#include "mappermmc1.h"
+#include "mapperuxrom.h"
+#include "mappercnrom.h"
+#include "mappermmc3.h"
+#include "mapperaxrom.h"
+#include "ppubus.h"
+#include "romhash.h"
+#include "romdatabase.h"
 
 Rom::Rom(System *system) {
     this->system = system;
@@ -13,50 +21,230 @@ Rom::Rom(System *system) {
     this->prgRomSize = 0;
     this->chrRom = nullptr;
     this->chrRomSize = 0;
+    this->chrRam = nullptr;
+    this->hasChrRam = false;
+    this->mapperNumber = 0;
+    this->submapper = 0;
+    this->mirroring = NametableMirroring_Horizontal;
+    this->battery = false;
+    this->prgRamSize = 0;
+    this->prgNvramSize = 0;
+    this->timing = RomTiming_Ntsc;
+    this->nes20 = false;
+    this->headerCorrected = false;
 }
 
 Rom::~Rom() {
-    delete[] this->chrRom;
-    delete[] this->prgRom;
-    delete[] this->trainer;
+    delete[] this->chrRam;
 }
 
-bool Rom::load(const char *path) {
-    InesHeader header;
+const char *Rom::load(const char *path, const RomDatabase *database) {
+    if (!image.open(path)) {
+        return "can't read the file";
+    }
 
-    printf("Load %s\n", path);
+    const char *error = image.unpack();
+    if (!error) {
+        error = parse(image.getData(), image.getSize(), database);
+    }
+    if (error) {
+        image.close();
+    }
+    return error;
+}
 
-    FILE *f = fopen(path, "rb");
-    fread(&header, sizeof(InesHeader), 1, f);
+// well past the largest real cart, and small enough that sizes fit in 32 bits
+const uint64_t ROM_SIZE_LIMIT = 0x40000000;
 
-    if (memcmp(header.magic, "NES\x1A", 4) != 0) {
-        fclose(f);
-        return false;
+// NES 2.0 sizes are a count of units with an extra high nibble, or when that's 0xF, an exponent
+// and multiplier packed into the low byte
+static uint64_t getNes20RomSize(unsigned low, unsigned high, unsigned unit) {
+    if (high == 0xF) {
+        // exponents can go far past anything that would fit in a file
+        if ((low >> 2) > 32) {
+            return UINT64_MAX;
+        }
+        return (static_cast<uint64_t>(1) << (low >> 2)) * ((low & 3) * 2 + 1);
     }
+    return static_cast<uint64_t>((high << 8) | low) * unit;
+}
 
-    bool verticalMirroring = header.flags6 & InesFlags6_UsesVerticalMirroring;
-    bool batteryPrgRam = header.flags6 & InesFlags6_BatteryBackedPrgRam;
-    bool containsTrainer = header.flags6 & InesFlags6_ContainsTrainer;
-    bool ignoreMirroringBit = header.flags6 & InesFlags6_IgnoreMirroringBit;
-    mapperNumber = ((header.flags6 >> 4) & 0xF) | (header.flags7 & 0xF0);
+// RAM sizes are a shift count, 64 << n bytes, with 0 meaning none
+static uint32_t getNes20RamSize(unsigned shift) {
+    return shift == 0 ? 0 : 64U << shift;
+}
 
-    trainerSize = containsTrainer ? 512 : 0;
-    if (trainerSize != 0) {
-        trainer = new byte[trainerSize];
-        fread(trainer, trainerSize, 1, f);
+const char *parseInesHeader(const byte *data, size_t size, RomHeader *header) {
+    InesHeader ines;
+    if (size < sizeof(InesHeader)) {
+        return "too short for a header";
     }
+    memcpy(&ines, data, sizeof(InesHeader));
 
-    prgRomSize = header.prgRomSize * 16384;
-    prgRom = new byte[prgRomSize];
-    fread(prgRom, prgRomSize, 1, f);
+    if (memcmp(ines.magic, "NES\x1A", 4) != 0) {
+        return "not an iNES file";
+    }
 
-    chrRomSize = header.chrRomSize * 8192;
-    chrRom = new byte[chrRomSize];
-    fread(chrRom, chrRomSize, 1, f);
+    header->nes20 = (ines.flags7 & InesFlags7_FormatMask) == InesFlags7_FormatNes20;
+    header->trainerSize = (ines.flags6 & InesFlags6_ContainsTrainer) ? 512 : 0;
+    header->battery = (ines.flags6 & InesFlags6_BatteryBackedPrgRam) != 0;
 
-    fclose(f);
+    if (ines.flags6 & InesFlags6_IgnoreMirroringBit) {
+        header->mirroring = NametableMirroring_FourScreen;
+    } else {
+        header->mirroring = (ines.flags6 & InesFlags6_UsesVerticalMirroring) ? NametableMirroring_Vertical : NametableMirroring_Horizontal;
+    }
+
+    uint64_t prgRomSize;
+    uint64_t chrRomSize;
+    header->mapperNumber = (ines.flags6 >> 4) & 0xF;
+
+    if (header->nes20) {
+        header->mapperNumber |= (ines.flags7 & 0xF0) | ((ines.flags8 & 0x0F) << 8);
+        header->submapper = ines.flags8 >> 4;
+        prgRomSize = getNes20RomSize(ines.prgRomSize, ines.flags9 & 0x0F, 0x4000);
+        chrRomSize = getNes20RomSize(ines.chrRomSize, ines.flags9 >> 4, 0x2000);
+        header->prgRamSize = getNes20RamSize(ines.flags10 & 0x0F);
+        header->prgNvramSize = getNes20RamSize(ines.flags10 >> 4);
+        header->chrRamSize = getNes20RamSize(ines.flags11 & 0x0F);
+        header->chrNvramSize = getNes20RamSize(ines.flags11 >> 4);
+        header->timing = ines.flags12 & 3;
+    } else {
+        // junk in the padding means the whole of byte 7 is probably junk too
+        bool padded = ines.flags12 == 0 && ines.flags13 == 0 && ines.flags14 == 0 && ines.flags15 == 0;
+        if (padded && (ines.flags7 & InesFlags7_FormatMask) == 0) {
+            header->mapperNumber |= ines.flags7 & 0xF0;
+        }
+        header->submapper = 0;
+        prgRomSize = ines.prgRomSize * 0x4000;
+        chrRomSize = ines.chrRomSize * 0x2000;
+        header->prgRamSize = 0x2000;
+        header->prgNvramSize = 0;
+        if (header->battery) {
+            header->prgNvramSize = header->prgRamSize;
+            header->prgRamSize = 0;
+        }
+        header->chrRamSize = chrRomSize == 0 ? 0x2000 : 0;
+        header->chrNvramSize = 0;
+        header->timing = (padded && (ines.flags9 & 1)) ? RomTiming_Pal : RomTiming_Ntsc;
+    }
+
+    if (prgRomSize == 0) {
+        return "no PRG ROM";
+    }
+    if (prgRomSize > ROM_SIZE_LIMIT || chrRomSize > ROM_SIZE_LIMIT) {
+        return "PRG or CHR too large";
+    }
+    // NES 2.0 exponent sizes can be anything, but mappers switch whole 8 KiB PRG and 1 KiB CHR banks
+    if (prgRomSize % PRG_BANK_SIZE != 0) {
+        return "PRG not a multiple of 8 KiB";
+    }
+    if (chrRomSize % CHR_BANK_SIZE != 0) {
+        return "CHR not a multiple of 1 KiB";
+    }
+
+    header->prgRomSize = static_cast<uint32_t>(prgRomSize);
+    header->chrRomSize = static_cast<uint32_t>(chrRomSize);
+    return nullptr;
+}
+
+uint64_t getInesImageSize(const RomHeader &header) {
+    return sizeof(InesHeader) + static_cast<uint64_t>(header.trainerSize) + header.prgRomSize + header.chrRomSize;
+}
+
+// anything past CHR, such as PlayChoice data, is ignored
+const char *checkInesImageSize(const RomHeader &header, size_t size) {
+    return size < getInesImageSize(header) ? "truncated" : nullptr;
+}
+
+const char *checkRomHeader(const RomHeader &header) {
+    if (header.prgRomSize == 0 || header.prgRomSize > ROM_SIZE_LIMIT || header.prgRomSize % PRG_BANK_SIZE != 0) {
+        return "bad PRG size";
+    }
+    if (header.chrRomSize > ROM_SIZE_LIMIT || header.chrRomSize % CHR_BANK_SIZE != 0) {
+        return "bad CHR size";
+    }
+    // 12 bits of mapper and 4 of submapper in NES 2.0
+    if (header.mapperNumber < 0 || header.mapperNumber > 0xFFF || header.submapper < 0 || header.submapper > 0xF) {
+        return "bad mapper";
+    }
+    if (header.mirroring < NametableMirroring_Horizontal || header.mirroring > NametableMirroring_FourScreen) {
+        return "bad mirroring";
+    }
+    if (header.timing < RomTiming_Ntsc || header.timing > RomTiming_Dendy) {
+        return "bad timing";
+    }
+
+    // the most a NES 2.0 shift count can say
+    uint32_t ramLimit = getNes20RamSize(0xF);
+    if (header.prgRamSize > ramLimit || header.prgNvramSize > ramLimit || header.chrRamSize > ramLimit || header.chrNvramSize > ramLimit) {
+        return "bad RAM size";
+    }
+    return nullptr;
+}
+
+// PRG, CHR and the trainer are left pointing into the image, which has to outlive the Rom.
+// Returns why the image was rejected, or null.
+const char *Rom::parse(const byte *data, size_t size, const RomDatabase *database) {
+    RomHeader header;
+    const char *error = parseInesHeader(data, size, &header);
+    if (!error) {
+        error = checkInesImageSize(header, size);
+    }
+    if (error) {
+        return error;
+    }
+
+    const byte *next = data + sizeof(InesHeader);
+    trainerSize = header.trainerSize;
+    trainer = trainerSize != 0 ? next : nullptr;
+    next += trainerSize;
+    prgRomSize = header.prgRomSize;
+    prgRom = next;
+    next += prgRomSize;
+    chrRomSize = header.chrRomSize;
+    chrRom = next;
+
+    if (database) {
+        RomHash hash;
+        hashRom(prgRom, prgRomSize, chrRom, chrRomSize, &hash);
+
+        // the database is text that may have been edited by hand, so its header is checked again
+        const RomDatabaseGame *game = database->findGame(hash);
+        if (game && game->header.prgRomSize == header.prgRomSize && game->header.chrRomSize == header.chrRomSize
+            && checkRomHeader(game->header) == nullptr) {
+            if (game->header.mapperNumber != header.mapperNumber || game->header.submapper != header.submapper
+                || game->header.mirroring != header.mirroring) {
+                headerCorrected = true;
+            }
+            header = game->header;
+        }
+    }
+    setHeader(header);
 
-    return true;
+    hasChrRam = chrRomSize == 0;
+    if (hasChrRam) {
+        chrRam = new byte[CHR_RAM_SIZE];
+        memset(chrRam, 0, CHR_RAM_SIZE);
+        chrRom = chrRam;
+        chrRomSize = CHR_RAM_SIZE;
+    }
+    chrCache.build(chrRom, chrRomSize);
+
+    return nullptr;
+}
+
+// the sizes and where things are in the file are left alone, a database header only
+// changes how the cartridge is wired
+void Rom::setHeader(const RomHeader &header) {
+    mapperNumber = header.mapperNumber;
+    submapper = header.submapper;
+    mirroring = header.mirroring;
+    battery = header.battery;
+    prgRamSize = header.prgRamSize;
+    prgNvramSize = header.prgNvramSize;
+    timing = header.timing;
+    nes20 = header.nes20;
 }
 
 void Rom::dump() {
@@ -80,6 +268,26 @@ Mapper *Rom::createMapper() {
         case 0x00: {
             return new MapperNROM(this);
         }
+
+        case 0x01: {
+            return new MapperMMC1(this);
+        }
+
+        case 0x02: {
+            return new MapperUxROM(this);
+        }
+
+        case 0x03: {
+            return new MapperCNROM(this);
+        }
+
+        case 0x04: {
+            return new MapperMMC3(this);
+        }
+
+        case 0x07: {
+            return new MapperAxROM(this);
+        }
     }
 
     return nullptr;
@@ -1,9 +1,12 @@
 #pragma once
 #include <cstdint>
 #include "armadadef.h"
+#include "chrcache.h"
+#include "romimage.h"
 
 class System;
 class Mapper;
+class RomDatabase;
 
 struct InesHeader {
     union {
@@ -18,37 +21,108 @@ struct InesHeader {
     uint8_t flags8;
     uint8_t flags9;
     uint8_t flags10;
-    uint8_t padding11, padding12, padding13, padding14, padding15;
+    // NES 2.0 only, padding in iNES 1.0, where they're often junk like "DiskDude!"
+    uint8_t flags11, flags12, flags13, flags14, flags15;
 };
 
 enum {
     InesFlags6_UsesVerticalMirroring            = 1 << 0,
     InesFlags6_BatteryBackedPrgRam              = 1 << 1,
     InesFlags6_ContainsTrainer                  = 1 << 2,
-    InesFlags6_IgnoreMirroringBit               = 1 << 3,
+    InesFlags6_IgnoreMirroringBit               = 1 << 3, // four-screen VRAM
 };
 
+enum {
+    InesFlags7_FormatMask                       = 0x0C,
+    InesFlags7_FormatNes20                      = 0x08,
+};
+
+enum {
+    RomTiming_Ntsc,
+    RomTiming_Pal,
+    RomTiming_Multiple,
+    RomTiming_Dendy,
+};
+
+// everything an iNES or NES 2.0 header says, decoded
+struct RomHeader {
+    bool nes20;
+    uint32_t trainerSize;
+    uint32_t prgRomSize;
+    uint32_t chrRomSize;
+
+    int mapperNumber;
+    int submapper;
+    // one of NametableMirroring_*
+    int mirroring;
+    bool battery;
+    // in bytes, iNES 1.0 headers get the usual 8 KiB of PRG RAM and of CHR RAM when there's no CHR ROM
+    uint32_t prgRamSize;
+    uint32_t prgNvramSize;
+    uint32_t chrRamSize;
+    uint32_t chrNvramSize;
+    // one of RomTiming_*
+    int timing;
+};
+
+// Decodes and checks the 16-byte header alone, returns why it's bad or null. Whether the file is
+// long enough for what it describes is left to checkInesImageSize.
+const char *parseInesHeader(const byte *data, size_t size, RomHeader *header);
+
+// the header, trainer, PRG and CHR, anything after them is ignored
+uint64_t getInesImageSize(const RomHeader &header);
+// returns why an image of size bytes can't hold what the header says, or null
+const char *checkInesImageSize(const RomHeader &header, size_t size);
+
+// Checks every field is one the emulator can be given, for headers that didn't come from
+// parseInesHeader, such as hand-edited database entries. Returns why not or null.
+const char *checkRomHeader(const RomHeader &header);
+
 class Rom {
 public:
     Rom(System *system);
     ~Rom();
 
-    bool load(const char *path);
+    // The file is mapped rather than copied, PRG and CHR point straight into it, or into the buffer
+    // a .gz or .zip is inflated into. With a database, PRG and CHR are hashed and a known dump gets
+    // the database's header instead of its own. Returns why it can't be loaded or null.
+    const char *load(const char *path, const RomDatabase *database = nullptr);
 
-    byte *trainer;
+    const byte *trainer;
     uint32_t trainerSize;
-    byte *prgRom;
+    const byte *prgRom;
     uint32_t prgRomSize;
-    byte *chrRom;
+    const byte *chrRom;
     uint32_t chrRomSize;
+    // carts without CHR ROM have 8 KiB of RAM in its place, which chrRom points at all the same
+    byte *chrRam;
+    bool hasChrRam;
+    ChrCache chrCache;
 
     int mapperNumber;
+    int submapper;
+    // one of NametableMirroring_*, as wired by the cartridge
+    int mirroring;
+    bool battery;
+    uint32_t prgRamSize;
+    uint32_t prgNvramSize;
+    // one of RomTiming_*, only NTSC is emulated
+    int timing;
+    bool nes20;
+    // set when the database's header replaced a different mapper or mirroring from the file
+    bool headerCorrected;
     Mapper *createMapper();
 
     void dump();
 
+    System *getSystem() const { return this->system; }
+
 private:
+    const char *parse(const byte *data, size_t size, const RomDatabase *database);
+    void setHeader(const RomHeader &header);
+
     System *system;
+    RomImage image;
 };
 
 
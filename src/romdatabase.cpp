@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+#include "romdatabase.h"
+
+static const char ROM_DATABASE_MAGIC[] = "# armadanes rom database 1";
+
+static void formatHash(const RomHash &hash, char *out) {
+    snprintf(out, 9, "%08" PRIx32, hash.crc32);
+    for (unsigned i = 0; i < SHA1_SIZE; i++) {
+        snprintf(out + 8 + i * 2, 3, "%02x", hash.sha1[i]);
+    }
+}
+
+// 8 hex digits of CRC-32 and 40 of SHA-1, run together
+static bool parseHash(const char *text, RomHash *hash) {
+    if (strlen(text) != 8 + SHA1_SIZE * 2 || sscanf(text, "%8" SCNx32, &hash->crc32) != 1) {
+        return false;
+    }
+    for (unsigned i = 0; i < SHA1_SIZE; i++) {
+        unsigned value;
+        if (sscanf(text + 8 + i * 2, "%2x", &value) != 1) {
+            return false;
+        }
+        hash->sha1[i] = static_cast<byte>(value);
+    }
+    return true;
+}
+
+std::string RomDatabase::getKey(const RomHash &hash) {
+    std::string key(reinterpret_cast<const char *>(&hash.crc32), sizeof(hash.crc32));
+    key.append(reinterpret_cast<const char *>(hash.sha1), SHA1_SIZE);
+    return key;
+}
+
+// game <hash> <prg> <chr> <mapper> <submapper> <mirroring> <battery> <prg ram> <prg nvram> <chr ram> <chr nvram> <timing> <nes 2.0>
+// file <hash> <size> <mtime> <path to the end of the line>
+bool RomDatabase::load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return true;
+    }
+
+    char line[4096];
+    if (!fgets(line, sizeof(line), f) || strncmp(line, ROM_DATABASE_MAGIC, strlen(ROM_DATABASE_MAGIC)) != 0) {
+        fclose(f);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char hashText[64];
+        if (strncmp(line, "game ", 5) == 0) {
+            RomDatabaseGame game;
+            RomHeader *h = &game.header;
+            int battery;
+            int nes20;
+            if (sscanf(line + 5, "%63s %" SCNu32 " %" SCNu32 " %d %d %d %d %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32 " %d %d",
+                    hashText, &h->prgRomSize, &h->chrRomSize, &h->mapperNumber, &h->submapper, &h->mirroring, &battery,
+                    &h->prgRamSize, &h->prgNvramSize, &h->chrRamSize, &h->chrNvramSize, &h->timing, &nes20) != 13
+                || !parseHash(hashText, &game.hash)) {
+                continue;
+            }
+            h->battery = battery != 0;
+            h->nes20 = nes20 != 0;
+            h->trainerSize = 0;
+            // lines fixed by hand can have anything in them
+            if (checkRomHeader(*h) != nullptr) {
+                continue;
+            }
+            games[getKey(game.hash)] = game;
+        } else if (strncmp(line, "file ", 5) == 0) {
+            RomDatabaseFile file;
+            int pathStart = 0;
+            if (sscanf(line + 5, "%63s %" SCNu64 " %" SCNd64 " %n", hashText, &file.size, &file.mtime, &pathStart) != 3
+                || pathStart == 0 || !parseHash(hashText, &file.hash)) {
+                continue;
+            }
+            file.path = line + 5 + pathStart;
+            files[file.path] = file;
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+bool RomDatabase::save(const char *path) const {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+
+    fprintf(f, "%s\n", ROM_DATABASE_MAGIC);
+
+    char hashText[8 + SHA1_SIZE * 2 + 1];
+    for (const auto &entry : games) {
+        const RomDatabaseGame &game = entry.second;
+        const RomHeader &h = game.header;
+        formatHash(game.hash, hashText);
+        fprintf(f, "game %s %" PRIu32 " %" PRIu32 " %d %d %d %d %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 " %d %d\n",
+            hashText, h.prgRomSize, h.chrRomSize, h.mapperNumber, h.submapper, h.mirroring, h.battery ? 1 : 0,
+            h.prgRamSize, h.prgNvramSize, h.chrRamSize, h.chrNvramSize, h.timing, h.nes20 ? 1 : 0);
+    }
+
+    for (const auto &entry : files) {
+        const RomDatabaseFile &file = entry.second;
+        formatHash(file.hash, hashText);
+        fprintf(f, "file %s %" PRIu64 " %" PRId64 " %s\n", hashText, file.size, file.mtime, file.path.c_str());
+    }
+
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+const RomDatabaseGame *RomDatabase::findGame(const RomHash &hash) const {
+    auto found = games.find(getKey(hash));
+    return found != games.end() ? &found->second : nullptr;
+}
+
+void RomDatabase::addGame(const RomDatabaseGame &game) {
+    std::string key = getKey(game.hash);
+    auto found = games.find(key);
+    if (found != games.end() && found->second.header.nes20 && !game.header.nes20) {
+        return;
+    }
+
+    RomDatabaseGame &stored = games[key];
+    stored = game;
+    // a trainer belongs to the file, not to the dump
+    stored.header.trainerSize = 0;
+}
+
+const RomDatabaseFile *RomDatabase::findFile(const std::string &path) const {
+    auto found = files.find(path);
+    return found != files.end() ? &found->second : nullptr;
+}
+
+void RomDatabase::addFile(const RomDatabaseFile &file) {
+    files[file.path] = file;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "rom.h"
+#include "romhash.h"
+
+// the header a dump should have, whatever header the file it was found in has
+struct RomDatabaseGame {
+    RomHash hash;
+    RomHeader header;
+};
+
+// a file that has been scanned, so it needn't be read again while its size and mtime are the same
+struct RomDatabaseFile {
+    std::string path;
+    uint64_t size;
+    int64_t mtime;
+    RomHash hash;
+};
+
+// Known dumps by the hash of their PRG and CHR, and the files they were found in. Kept on disk as
+// text, one record per line, so entries can be fixed by hand.
+class RomDatabase {
+public:
+    // a missing file is an empty database, not an error
+    bool load(const char *path);
+    bool save(const char *path) const;
+
+    const RomDatabaseGame *findGame(const RomHash &hash) const;
+    // a NES 2.0 header is trusted over an iNES 1.0 one, and is never replaced by one
+    void addGame(const RomDatabaseGame &game);
+
+    const RomDatabaseFile *findFile(const std::string &path) const;
+    void addFile(const RomDatabaseFile &file);
+
+    size_t getGameCount() const { return this->games.size(); }
+    size_t getFileCount() const { return this->files.size(); }
+
+private:
+    static std::string getKey(const RomHash &hash);
+
+    std::unordered_map<std::string, RomDatabaseGame> games;
+    std::unordered_map<std::string, RomDatabaseFile> files;
+};
@@ -0,0 +1,175 @@
+#include <cstring>
+#include "romhash.h"
+
+// table[0] is the usual byte-at-a-time table, table[k] is the CRC of a byte followed by k zeros
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    Crc32Tables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (unsigned bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320U : 0);
+            }
+            table[0][i] = crc;
+        }
+
+        for (unsigned k = 1; k < 8; k++) {
+            for (uint32_t i = 0; i < 256; i++) {
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+// assumes a little-endian host, as the rest of the core does
+uint32_t crc32(const byte *data, size_t size, uint32_t crc) {
+    static const Crc32Tables tables;
+    const uint32_t (*t)[256] = tables.table;
+
+    crc = ~crc;
+
+    while (size >= 8) {
+        uint32_t one;
+        uint32_t two;
+        memcpy(&one, data, 4);
+        memcpy(&two, data + 4, 4);
+        one ^= crc;
+
+        crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24]
+            ^ t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+
+        data += 8;
+        size -= 8;
+    }
+
+    while (size > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+        data++;
+        size--;
+    }
+
+    return ~crc;
+}
+
+static uint32_t rotateLeft(uint32_t value, unsigned count) {
+    return (value << count) | (value >> (32 - count));
+}
+
+Sha1::Sha1() {
+    this->state[0] = 0x67452301;
+    this->state[1] = 0xEFCDAB89;
+    this->state[2] = 0x98BADCFE;
+    this->state[3] = 0x10325476;
+    this->state[4] = 0xC3D2E1F0;
+    this->length = 0;
+    this->used = 0;
+}
+
+void Sha1::update(const byte *data, size_t size) {
+    length += size;
+
+    if (used > 0) {
+        size_t take = sizeof(block) - used < size ? sizeof(block) - used : size;
+        memcpy(block + used, data, take);
+        used += static_cast<unsigned>(take);
+        data += take;
+        size -= take;
+
+        if (used < sizeof(block)) {
+            return;
+        }
+        processBlock(block);
+        used = 0;
+    }
+
+    // whole blocks straight from the input, without copying them
+    while (size >= sizeof(block)) {
+        processBlock(data);
+        data += sizeof(block);
+        size -= sizeof(block);
+    }
+
+    memcpy(block, data, size);
+    used = static_cast<unsigned>(size);
+}
+
+void Sha1::finish(byte digest[SHA1_SIZE]) {
+    uint64_t bits = length * 8;
+
+    // a 1 bit, zeros up to 8 bytes short of a block, then the length in bits, big-endian
+    byte padding[64 + 8] = { 0x80 };
+    size_t padLength = (used < 56 ? 56 : 120) - used;
+    for (unsigned i = 0; i < 8; i++) {
+        padding[padLength + i] = static_cast<byte>(bits >> (56 - i * 8));
+    }
+    update(padding, padLength + 8);
+
+    for (unsigned i = 0; i < 5; i++) {
+        digest[i * 4 + 0] = static_cast<byte>(state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<byte>(state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<byte>(state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<byte>(state[i]);
+    }
+}
+
+void Sha1::processBlock(const byte *data) {
+    uint32_t w[80];
+    for (unsigned i = 0; i < 16; i++) {
+        w[i] = (static_cast<uint32_t>(data[i * 4]) << 24) | (static_cast<uint32_t>(data[i * 4 + 1]) << 16)
+            | (static_cast<uint32_t>(data[i * 4 + 2]) << 8) | data[i * 4 + 3];
+    }
+    for (unsigned i = 16; i < 80; i++) {
+        w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+
+    for (unsigned i = 0; i < 80; i++) {
+        uint32_t f;
+        uint32_t k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void hashRom(const byte *prg, size_t prgSize, const byte *chr, size_t chrSize, RomHash *hash) {
+    hash->crc32 = crc32(chr, chrSize, crc32(prg, prgSize));
+
+    Sha1 sha1;
+    sha1.update(prg, prgSize);
+    sha1.update(chr, chrSize);
+    sha1.finish(hash->sha1);
+}
+
+bool operator==(const RomHash &a, const RomHash &b) {
+    return a.crc32 == b.crc32 && memcmp(a.sha1, b.sha1, SHA1_SIZE) == 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "armadadef.h"
+
+const unsigned SHA1_SIZE = 20;
+
+// The standard (zlib) CRC-32, eight bytes at a time through eight tables. Chains, so data in
+// pieces can be passed with the previous result as crc.
+uint32_t crc32(const byte *data, size_t size, uint32_t crc = 0);
+
+class Sha1 {
+public:
+    Sha1();
+
+    void update(const byte *data, size_t size);
+    void finish(byte digest[SHA1_SIZE]);
+
+private:
+    void processBlock(const byte *block);
+
+    uint32_t state[5];
+    uint64_t length;
+    byte block[64];
+    unsigned used;
+};
+
+// identifies a dump by its PRG and CHR only, so the same game matches whatever header it has
+struct RomHash {
+    uint32_t crc32;
+    byte sha1[SHA1_SIZE];
+};
+
+void hashRom(const byte *prg, size_t prgSize, const byte *chr, size_t chrSize, RomHash *hash);
+bool operator==(const RomHash &a, const RomHash &b);
@@ -0,0 +1,306 @@
+#include <cstring>
+#include <vector>
+#include "romimage.h"
+#include "rom.h"
+#include "romhash.h"
+#include "inflate.h"
+
+const uint32_t ZIP_LOCAL_HEADER_MAGIC = 0x04034B50;
+const uint32_t ZIP_CENTRAL_HEADER_MAGIC = 0x02014B50;
+const uint32_t ZIP_END_MAGIC = 0x06054B50;
+const size_t ZIP_LOCAL_HEADER_SIZE = 30;
+const size_t ZIP_CENTRAL_HEADER_SIZE = 46;
+const size_t ZIP_END_SIZE = 22;
+
+enum {
+    GzipFlags_HeaderCrc                         = 1 << 1,
+    GzipFlags_Extra                             = 1 << 2,
+    GzipFlags_Name                              = 1 << 3,
+    GzipFlags_Comment                           = 1 << 4,
+    GzipFlags_Reserved                          = 0xE0,
+};
+
+enum {
+    ZipMethod_Stored                            = 0,
+    ZipMethod_Deflate                           = 8,
+};
+
+enum {
+    ZipFlags_Encrypted                          = 1 << 0,
+};
+
+// zip and gzip fields are little-endian wherever they are, aligned or not
+static uint16_t read16(const byte *data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+static uint32_t read32(const byte *data) {
+    return static_cast<uint32_t>(data[0] | (data[1] << 8) | (data[2] << 16)) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static bool hasExtension(const char *name, size_t length, const char *extension) {
+    size_t extensionLength = strlen(extension);
+    if (length < extensionLength) {
+        return false;
+    }
+
+    const char *end = name + length - extensionLength;
+    for (size_t i = 0; i < extensionLength; i++) {
+        if ((end[i] | 0x20) != extension[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isRomFileName(const char *name) {
+    size_t length = strlen(name);
+    return hasExtension(name, length, ".nes") || hasExtension(name, length, ".gz") || hasExtension(name, length, ".zip");
+}
+
+RomImage::RomImage() {
+    this->data = nullptr;
+    this->size = 0;
+    this->buffer = nullptr;
+}
+
+RomImage::~RomImage() {
+    close();
+}
+
+bool RomImage::open(const char *path) {
+    close();
+    return file.open(path);
+}
+
+void RomImage::close() {
+    file.close();
+    delete[] buffer;
+    buffer = nullptr;
+    data = nullptr;
+    size = 0;
+}
+
+// the container is recognised by its magic, so a renamed file still loads
+const char *RomImage::unpack() {
+    const byte *fileData = file.getData();
+    size_t fileSize = file.getSize();
+
+    if (fileSize >= 3 && fileData[0] == 0x1F && fileData[1] == 0x8B && fileData[2] == 8) {
+        return unpackGzip();
+    }
+    if (fileSize >= 4 && read32(fileData) == ZIP_LOCAL_HEADER_MAGIC) {
+        return unpackZip();
+    }
+
+    data = fileData;
+    size = fileSize;
+    return nullptr;
+}
+
+// RFC 1952: a header with optional fields, the deflate stream, then the CRC and size of the
+// contents. Only the first member is read.
+const char *RomImage::unpackGzip() {
+    const byte *fileData = file.getData();
+    size_t fileSize = file.getSize();
+    if (fileSize < 18) {
+        return "truncated gzip";
+    }
+
+    byte flags = fileData[3];
+    if (flags & GzipFlags_Reserved) {
+        return "unknown gzip flags";
+    }
+
+    size_t offset = 10;
+    if (flags & GzipFlags_Extra) {
+        offset += 2 + read16(fileData + offset);
+    }
+    if (flags & GzipFlags_Name) {
+        while (offset < fileSize && fileData[offset] != 0) {
+            offset++;
+        }
+        offset++;
+    }
+    if (flags & GzipFlags_Comment) {
+        while (offset < fileSize && fileData[offset] != 0) {
+            offset++;
+        }
+        offset++;
+    }
+    if (flags & GzipFlags_HeaderCrc) {
+        offset += 2;
+    }
+    if (offset + 8 > fileSize) {
+        return "truncated gzip";
+    }
+
+    // the size is only kept mod 2^32, which is still more than any image can be
+    uint32_t declaredCrc = read32(fileData + fileSize - 8);
+    uint32_t declaredSize = read32(fileData + fileSize - 4);
+    return inflateImage(fileData + offset, fileSize - 8 - offset, declaredSize, declaredCrc);
+}
+
+// Entries are found through the central directory at the end, which has their sizes even when
+// the local headers leave them to a descriptor after the data. Zip64 isn't needed for ROMs.
+const char *RomImage::unpackZip() {
+    const byte *fileData = file.getData();
+    size_t fileSize = file.getSize();
+    if (fileSize < ZIP_END_SIZE) {
+        return "truncated zip";
+    }
+
+    // the end record is followed by a comment of up to 64 KiB
+    const byte *end = nullptr;
+    size_t lowest = fileSize > ZIP_END_SIZE + 0xFFFF ? fileSize - ZIP_END_SIZE - 0xFFFF : 0;
+    for (size_t offset = fileSize - ZIP_END_SIZE + 1; offset-- > lowest;) {
+        if (read32(fileData + offset) == ZIP_END_MAGIC) {
+            end = fileData + offset;
+            break;
+        }
+    }
+    if (!end) {
+        return "no zip directory";
+    }
+
+    unsigned entryCount = read16(end + 10);
+    size_t directorySize = read32(end + 12);
+    size_t directoryOffset = read32(end + 16);
+    if (directoryOffset > fileSize || directorySize > fileSize - directoryOffset) {
+        return "bad zip directory";
+    }
+
+    const byte *entry = fileData + directoryOffset;
+    const byte *directoryEnd = entry + directorySize;
+    for (unsigned i = 0; i < entryCount; i++) {
+        if (directoryEnd - entry < static_cast<ptrdiff_t>(ZIP_CENTRAL_HEADER_SIZE) || read32(entry) != ZIP_CENTRAL_HEADER_MAGIC) {
+            return "bad zip directory";
+        }
+
+        unsigned flags = read16(entry + 8);
+        unsigned method = read16(entry + 10);
+        uint32_t declaredCrc = read32(entry + 16);
+        size_t compressedSize = read32(entry + 20);
+        size_t uncompressedSize = read32(entry + 24);
+        size_t nameLength = read16(entry + 28);
+        size_t entrySize = ZIP_CENTRAL_HEADER_SIZE + nameLength + read16(entry + 30) + read16(entry + 32);
+        size_t localOffset = read32(entry + 42);
+        const char *name = reinterpret_cast<const char *>(entry + ZIP_CENTRAL_HEADER_SIZE);
+
+        if (static_cast<size_t>(directoryEnd - entry) < entrySize) {
+            return "bad zip directory";
+        }
+        if (!hasExtension(name, nameLength, ".nes")) {
+            entry += entrySize;
+            continue;
+        }
+
+        if (flags & ZipFlags_Encrypted) {
+            return "encrypted zip entry";
+        }
+        if (localOffset > fileSize - ZIP_LOCAL_HEADER_SIZE || read32(fileData + localOffset) != ZIP_LOCAL_HEADER_MAGIC) {
+            return "bad zip entry";
+        }
+
+        // the local header's name and extra field can differ from the directory's
+        const byte *local = fileData + localOffset;
+        size_t dataOffset = localOffset + ZIP_LOCAL_HEADER_SIZE + read16(local + 26) + read16(local + 28);
+        if (dataOffset > fileSize || compressedSize > fileSize - dataOffset) {
+            return "truncated zip entry";
+        }
+
+        switch (method) {
+            case ZipMethod_Stored: {
+                if (compressedSize != uncompressedSize) {
+                    return "bad zip entry";
+                }
+                if (crc32(fileData + dataOffset, compressedSize) != declaredCrc) {
+                    return "CRC mismatch";
+                }
+                data = fileData + dataOffset;
+                size = compressedSize;
+                return nullptr;
+            }
+
+            case ZipMethod_Deflate: {
+                return inflateImage(fileData + dataOffset, compressedSize, uncompressedSize, declaredCrc);
+            }
+        }
+
+        return "unsupported zip compression";
+    }
+
+    return "no .nes file in the zip";
+}
+
+// The header is inflated first to size the buffer, then the image is inflated again from the start
+// into the buffer up to the end of CHR. Going over the first block twice is cheaper than
+// keeping a window of its own, and the buffer is never bigger than the header says.
+const char *RomImage::inflateImage(const byte *compressed, size_t compressedSize, uint64_t declaredSize, uint32_t declaredCrc) {
+    byte headerData[sizeof(InesHeader)];
+    size_t written;
+
+    Inflater peek(compressed, compressedSize);
+    const char *error = peek.inflate(headerData, sizeof(headerData), &written);
+    if (error) {
+        return error;
+    }
+
+    // the length isn't known until the rest is inflated, so only the header itself is checked here
+    RomHeader header;
+    error = parseInesHeader(headerData, written, &header);
+    if (error) {
+        return error;
+    }
+
+    uint64_t imageSize = getInesImageSize(header);
+    if (declaredSize < imageSize) {
+        return "truncated";
+    }
+
+    buffer = new byte[imageSize];
+    Inflater inflater(compressed, compressedSize);
+    error = inflater.inflate(buffer, imageSize, &written);
+    if (error) {
+        return error;
+    }
+    if (written < imageSize) {
+        return "truncated";
+    }
+
+    // The CRC and size cover the whole member, so whatever comes after CHR is inflated too, through
+    // a scratch buffer that keeps the last window for back-references, and then dropped.
+    uint32_t crc = crc32(buffer, imageSize);
+    uint64_t totalSize = imageSize;
+    if (!inflater.isFinished()) {
+        std::vector<byte> scratch(INFLATE_WINDOW_SIZE * 2);
+        size_t history = imageSize < INFLATE_WINDOW_SIZE ? imageSize : INFLATE_WINDOW_SIZE;
+        memcpy(scratch.data(), buffer + imageSize - history, history);
+
+        while (!inflater.isFinished()) {
+            error = inflater.resume(scratch.data(), history, scratch.size(), &written);
+            if (error) {
+                return error;
+            }
+            crc = crc32(scratch.data() + history, written, crc);
+            totalSize += written;
+            if (totalSize > declaredSize) {
+                return "longer than its declared size";
+            }
+
+            size_t end = history + written;
+            history = end < INFLATE_WINDOW_SIZE ? end : INFLATE_WINDOW_SIZE;
+            memmove(scratch.data(), scratch.data() + end - history, history);
+        }
+    }
+    if (totalSize != declaredSize) {
+        return "truncated";
+    }
+    if (crc != declaredCrc) {
+        return "CRC mismatch";
+    }
+
+    data = buffer;
+    size = imageSize;
+    return nullptr;
+}
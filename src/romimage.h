@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "armadadef.h"
+#include "mappedfile.h"
+
+// .nes, or the .gz and .zip files a RomImage can look inside, whatever the case
+bool isRomFileName(const char *name);
+
+// The iNES image in a ROM file: the file itself, the contents of a gzip file, or the first .nes
+// entry of a zip, stored or deflated. The file is mapped, so an uncompressed image is used where
+// it is, and a compressed one is inflated straight into a buffer sized from its header, with no
+// temporary file and nothing kept past the end of CHR. The CRC of the whole entry is checked.
+class RomImage {
+public:
+    RomImage();
+    ~RomImage();
+
+    // false when the file can't be read at all
+    bool open(const char *path);
+    // finds the image in the open file, returns why it can't or null
+    const char *unpack();
+    void close();
+
+    const byte *getData() const { return this->data; }
+    size_t getSize() const { return this->size; }
+    bool isCompressed() const { return this->buffer != nullptr; }
+
+private:
+    RomImage(const RomImage &) = delete;
+    RomImage &operator=(const RomImage &) = delete;
+
+    const char *unpackGzip();
+    const char *unpackZip();
+    const char *inflateImage(const byte *compressed, size_t compressedSize, uint64_t declaredSize, uint32_t declaredCrc);
+
+    MappedFile file;
+    const byte *data;
+    size_t size;
+    byte *buffer;
+};
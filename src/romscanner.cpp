@@ -0,0 +1,202 @@
+#include <chrono>
+#include <cstring>
+#include <thread>
+#if defined(_WIN32)
+#include "safewindows.h"
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include "romscanner.h"
+#include "romdatabase.h"
+#include "romimage.h"
+
+RomScanner::RomScanner(RomDatabase *database, unsigned threads) : next(0) {
+    this->database = database;
+
+    this->threadCount = threads;
+    if (this->threadCount == 0) {
+        this->threadCount = std::thread::hardware_concurrency();
+    }
+    if (this->threadCount == 0) {
+        this->threadCount = 1;
+    }
+
+    this->hashedCount = 0;
+    this->reusedCount = 0;
+    this->failedCount = 0;
+    this->hashedBytes = 0;
+    this->seconds = 0;
+}
+
+// The listing is done on one thread, since it's mostly waiting on the filesystem, and the files are
+// then shared out one at a time. Results go into the database afterwards, so workers only read it.
+bool RomScanner::scan(const char *directory) {
+    auto start = std::chrono::steady_clock::now();
+
+    files.clear();
+    findFiles(directory);
+    next = 0;
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threadCount; i++) {
+        workers.emplace_back(&RomScanner::work, this);
+    }
+    work();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    hashedCount = 0;
+    reusedCount = 0;
+    failedCount = 0;
+    hashedBytes = 0;
+
+    for (const ScanFile &file : files) {
+        switch (file.result) {
+            case ScanResult_Failed: {
+                failedCount++;
+                break;
+            }
+
+            case ScanResult_Reused: {
+                reusedCount++;
+                break;
+            }
+
+            case ScanResult_Hashed: {
+                hashedCount++;
+                hashedBytes += file.header.prgRomSize + file.header.chrRomSize;
+
+                RomDatabaseFile entry;
+                entry.path = file.path;
+                entry.size = file.size;
+                entry.mtime = file.mtime;
+                entry.hash = file.hash;
+                database->addFile(entry);
+
+                RomDatabaseGame game;
+                game.hash = file.hash;
+                game.header = file.header;
+                database->addGame(game);
+                break;
+            }
+        }
+    }
+
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return failedCount == 0;
+}
+
+void RomScanner::work() {
+    for (;;) {
+        size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= files.size()) {
+            return;
+        }
+        scanFile(&files[index]);
+    }
+}
+
+void RomScanner::scanFile(ScanFile *file) {
+    const RomDatabaseFile *known = database->findFile(file->path);
+    if (known && known->size == file->size && known->mtime == file->mtime) {
+        file->hash = known->hash;
+        file->result = ScanResult_Reused;
+        return;
+    }
+
+    file->result = ScanResult_Failed;
+
+    RomImage image;
+    if (!image.open(file->path.c_str()) || image.unpack() != nullptr) {
+        return;
+    }
+    if (parseInesHeader(image.getData(), image.getSize(), &file->header) != nullptr
+        || checkInesImageSize(file->header, image.getSize()) != nullptr) {
+        return;
+    }
+
+    const byte *prg = image.getData() + sizeof(InesHeader) + file->header.trainerSize;
+    const byte *chr = prg + file->header.prgRomSize;
+    hashRom(prg, file->header.prgRomSize, chr, file->header.chrRomSize, &file->hash);
+    file->result = ScanResult_Hashed;
+}
+
+#if defined(_WIN32)
+// FILETIME is in 100 ns units since 1601, converted to seconds since 1970 to match stat
+static int64_t getUnixTime(const FILETIME &time) {
+    uint64_t ticks = (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    return static_cast<int64_t>(ticks / 10000000ULL) - 11644473600LL;
+}
+
+void RomScanner::findFiles(const std::string &directory) {
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    do {
+        if (!strcmp(found.cFileName, ".") || !strcmp(found.cFileName, "..")) {
+            continue;
+        }
+
+        // junctions and directory symlinks can point back up the tree, so they aren't followed
+        std::string path = directory + "\\" + found.cFileName;
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!(found.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                findFiles(path);
+            }
+        } else if (isRomFileName(found.cFileName)) {
+            ScanFile file;
+            file.path = path;
+            file.size = (static_cast<uint64_t>(found.nFileSizeHigh) << 32) | found.nFileSizeLow;
+            file.mtime = getUnixTime(found.ftLastWriteTime);
+            file.result = ScanResult_Failed;
+            files.push_back(file);
+        }
+    } while (FindNextFileA(search, &found));
+
+    FindClose(search);
+}
+#else
+void RomScanner::findFiles(const std::string &directory) {
+    DIR *dir = opendir(directory.c_str());
+    if (!dir) {
+        return;
+    }
+
+    while (struct dirent *entry = readdir(dir)) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+
+        // A symlinked directory can point back up the tree, so only real directories are walked.
+        // A symlinked file is still scanned, as whatever it points at.
+        std::string path = directory + "/" + entry->d_name;
+        struct stat info;
+        if (lstat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        if (S_ISLNK(info.st_mode)) {
+            if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+                continue;
+            }
+        }
+
+        if (S_ISDIR(info.st_mode)) {
+            findFiles(path);
+        } else if (S_ISREG(info.st_mode) && isRomFileName(entry->d_name)) {
+            ScanFile file;
+            file.path = path;
+            file.size = static_cast<uint64_t>(info.st_size);
+            file.mtime = static_cast<int64_t>(info.st_mtime);
+            file.result = ScanResult_Failed;
+            files.push_back(file);
+        }
+    }
+
+    closedir(dir);
+}
+#endif
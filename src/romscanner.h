@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "rom.h"
+#include "romhash.h"
+
+class RomDatabase;
+
+// Indexes every .nes, .gz and .zip file under a directory into a RomDatabase. Files are hashed on
+// all threads at once, and a file the database already has with the same size and mtime isn't
+// read at all.
+class RomScanner {
+public:
+    // 0 uses one thread per core
+    RomScanner(RomDatabase *database, unsigned threads);
+
+    bool scan(const char *directory);
+
+    unsigned getThreadCount() const { return this->threadCount; }
+    unsigned getFileCount() const { return static_cast<unsigned>(this->files.size()); }
+    unsigned getHashedCount() const { return this->hashedCount; }
+    unsigned getReusedCount() const { return this->reusedCount; }
+    unsigned getFailedCount() const { return this->failedCount; }
+    uint64_t getHashedBytes() const { return this->hashedBytes; }
+    double getSeconds() const { return this->seconds; }
+
+private:
+    enum {
+        ScanResult_Failed,
+        ScanResult_Hashed,
+        ScanResult_Reused,
+    };
+
+    struct ScanFile {
+        std::string path;
+        uint64_t size;
+        int64_t mtime;
+
+        int result;
+        RomHash hash;
+        RomHeader header;
+    };
+
+    void findFiles(const std::string &directory);
+    void work();
+    void scanFile(ScanFile *file);
+
+    RomDatabase *database;
+    unsigned threadCount;
+
+    std::vector<ScanFile> files;
+    std::atomic<size_t> next;
+
+    unsigned hashedCount;
+    unsigned reusedCount;
+    unsigned failedCount;
+    uint64_t hashedBytes;
+    double seconds;
+};
@@ -0,0 +1,167 @@
+// Header checks that have to hold before a mapper ever sees the ROM. Run by ctest.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "rom.h"
+#include "system.h"
+#include "romdatabase.h"
+#include "romhash.h"
+#include "ppubus.h"
+
+static unsigned failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// an NES 2.0 header with the PRG and CHR sizes in the exponent form, followed by that much data
+static std::vector<byte> makeNes20Image(byte prgSize, byte chrSize, uint64_t dataSize) {
+    std::vector<byte> image(sizeof(InesHeader) + dataSize, 0);
+    InesHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "NES\x1A", 4);
+    header.prgRomSize = prgSize;
+    header.chrRomSize = chrSize;
+    header.flags7 = InesFlags7_FormatNes20;
+    header.flags9 = 0xFF;
+    memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+// 2^exponent * (multiplier * 2 + 1)
+static byte getExponentSize(unsigned exponent, unsigned multiplier) {
+    return static_cast<byte>((exponent << 2) | multiplier);
+}
+
+static void testShortPrg() {
+    // 4 KiB of PRG and 8 KiB of CHR
+    std::vector<byte> image = makeNes20Image(getExponentSize(12, 0), getExponentSize(13, 0), 0x1000 + 0x2000);
+    RomHeader header;
+    check(parseInesHeader(image.data(), image.size(), &header) != nullptr, "4 KiB PRG is rejected");
+
+    // and the whole load fails rather than reaching the mapper
+    const char *path = "armadanes-romtest.nes";
+    FILE *f = fopen(path, "wb");
+    check(f != nullptr, "temporary ROM can be written");
+    if (f) {
+        fwrite(image.data(), 1, image.size(), f);
+        fclose(f);
+
+        System system;
+        check(system.loadRom(path) != nullptr, "4 KiB PRG doesn't load");
+        remove(path);
+    }
+}
+
+static void testPartialChrBank() {
+    // 8 KiB of PRG and 1.5 KiB of CHR
+    std::vector<byte> image = makeNes20Image(getExponentSize(13, 0), getExponentSize(9, 1), 0x2000 + 0x600);
+    RomHeader header;
+    check(parseInesHeader(image.data(), image.size(), &header) != nullptr, "1.5 KiB CHR is rejected");
+}
+
+static void testWholeBanks() {
+    // 24 KiB of PRG and 3 KiB of CHR are odd, but whole banks
+    std::vector<byte> image = makeNes20Image(getExponentSize(13, 1), getExponentSize(10, 1), 0x6000 + 0xC00);
+    RomHeader header;
+    check(parseInesHeader(image.data(), image.size(), &header) == nullptr, "24 KiB PRG and 3 KiB CHR are accepted");
+    check(header.prgRomSize == 0x6000 && header.chrRomSize == 0xC00, "exponent sizes are decoded");
+    check(checkInesImageSize(header, image.size()) == nullptr, "whole image is long enough");
+
+    // the header decodes on its own, and only the size check knows the rest is missing
+    check(parseInesHeader(image.data(), sizeof(InesHeader), &header) == nullptr, "header alone is decoded");
+    check(checkInesImageSize(header, image.size() - 1) != nullptr, "one byte short is truncated");
+}
+
+static bool writeFile(const char *path, const void *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+// a hand-edited database line can't be allowed to reach the PPU's mirroring table
+static void testBadDatabaseHeader() {
+    // 16 KiB of PRG and 8 KiB of CHR, iNES 1.0, vertical mirroring
+    std::vector<byte> image(sizeof(InesHeader) + 0x4000 + 0x2000, 0);
+    memcpy(image.data(), "NES\x1A\x01\x01\x01", 7);
+    image[sizeof(InesHeader) + 0x3FFD] = 0x80;
+
+    RomHash hash;
+    const byte *prg = image.data() + sizeof(InesHeader);
+    hashRom(prg, 0x4000, prg + 0x4000, 0x2000, &hash);
+
+    char hashText[8 + SHA1_SIZE * 2 + 1];
+    snprintf(hashText, 9, "%08x", static_cast<unsigned>(hash.crc32));
+    for (unsigned i = 0; i < SHA1_SIZE; i++) {
+        snprintf(hashText + 8 + i * 2, 3, "%02x", hash.sha1[i]);
+    }
+
+    const char *romPath = "armadanes-romtest.nes";
+    const char *databasePath = "armadanes-romtest.db";
+    const char *lines[] = {
+        "game %s 16384 8192 0 0 100000 0 0 8192 0 0 0 1\n",
+        "game %s 16384 8192 0 0 0 0 0 8192 0 0 9 1\n",
+        "game %s 16384 8192 0 99 0 0 0 8192 0 0 0 1\n",
+        "game %s 16384 8192 0 0 0 0 4294967295 0 0 0 0 1\n",
+    };
+
+    check(writeFile(romPath, image.data(), image.size()), "temporary ROM can be written");
+
+    for (const char *line : lines) {
+        char text[256];
+        int length = snprintf(text, sizeof(text), "# armadanes rom database 1\n");
+        snprintf(text + length, sizeof(text) - length, line, hashText);
+        check(writeFile(databasePath, text, strlen(text)), "temporary database can be written");
+
+        RomDatabase database;
+        check(database.load(databasePath), "database with a bad line still loads");
+        check(database.getGameCount() == 0, "out of range database line is dropped");
+
+        System system;
+        system.setRomDatabase(&database);
+        check(system.loadRom(romPath) == nullptr, "ROM loads with the file's own header");
+        check(system.getRom()->mirroring == NametableMirroring_Vertical, "file's mirroring is kept");
+    }
+
+    RomHeader header;
+    check(parseInesHeader(image.data(), image.size(), &header) == nullptr && checkRomHeader(header) == nullptr,
+        "a parsed header passes the check");
+    header.mirroring = 100000;
+    check(checkRomHeader(header) != nullptr, "mirroring past four-screen is rejected");
+
+    // and Rom::parse checks again, whatever put the entry in the database
+    RomDatabase database;
+    RomDatabaseGame game;
+    game.hash = hash;
+    game.header = header;
+    database.addGame(game);
+
+    System system;
+    system.setRomDatabase(&database);
+    check(system.loadRom(romPath) == nullptr, "ROM loads past a bad database entry");
+    check(system.getRom()->mirroring == NametableMirroring_Vertical, "bad database entry isn't adopted");
+
+    remove(romPath);
+    remove(databasePath);
+}
+
+int main() {
+    testShortPrg();
+    testPartialChrBank();
+    testWholeBanks();
+    testBadDatabaseHeader();
+
+    if (failures != 0) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "rowpool.h"
+
+RowPool::RowPool(unsigned threads) {
+    this->threadCount = threads != 0 ? threads : std::thread::hardware_concurrency();
+    if (this->threadCount == 0) {
+        this->threadCount = 1;
+    }
+
+    this->generation = 0;
+    this->pending = 0;
+    this->stopping = false;
+    this->rows = 0;
+    this->callback = nullptr;
+    this->userData = nullptr;
+
+    for (unsigned i = 1; i < threadCount; i++) {
+        workers.push_back(std::thread(&RowPool::work, this, i));
+    }
+}
+
+RowPool::~RowPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void RowPool::run(unsigned rows, RowCallback callback, void *userData) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->rows = rows;
+        this->callback = callback;
+        this->userData = userData;
+        pending = threadCount - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    runBand(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this]() { return pending == 0; });
+}
+
+void RowPool::work(unsigned index) {
+    unsigned seen = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&]() { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+
+        runBand(index);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            last = --pending == 0;
+        }
+        if (last) {
+            done.notify_one();
+        }
+    }
+}
+
+void RowPool::runBand(unsigned index) {
+    unsigned start = rows * index / threadCount;
+    unsigned end = rows * (index + 1) / threadCount;
+    if (start < end) {
+        callback(start, end, index, userData);
+    }
+}
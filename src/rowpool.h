@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// called once per band; worker is the index of the thread running it, for per-thread scratch space
+typedef void (*RowCallback)(unsigned start, unsigned end, unsigned worker, void *userData);
+
+// Splits a frame's rows into one horizontal band per thread and runs them all at once. The
+// calling thread takes the first band itself, so a pool of 1 runs everything inline.
+class RowPool {
+public:
+    // 0 uses one thread per core
+    RowPool(unsigned threads);
+    ~RowPool();
+
+    // returns once every band is done
+    void run(unsigned rows, RowCallback callback, void *userData);
+
+    unsigned getThreadCount() const { return this->threadCount; }
+
+private:
+    void work(unsigned index);
+    void runBand(unsigned index);
+
+    unsigned threadCount;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned generation;
+    unsigned pending;
+    bool stopping;
+
+    // the job for the current generation
+    unsigned rows;
+    RowCallback callback;
+    void *userData;
+};
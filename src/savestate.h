@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+#include "armadadef.h"
+#include "cpudefs.h"
+#include "ppu.h"
+#include "mapper.h"
+
+const char SAVESTATE_MAGIC[4] = { 'A', 'N', 'S', 'S' };
+const uint32_t SAVESTATE_VERSION = 5;
+
+const unsigned CPU_RAM_SIZE = 0x800;
+// 2 KiB in the console, and the 2 KiB a four-screen cartridge adds
+const unsigned PPU_RAM_SIZE = 0x1000;
+const unsigned MAPPER_STATE_SIZE = 64;
+
+struct CpuState {
+    CpuRegisters registers;
+    uint32_t cyclesToSkip;
+    uint32_t totalCycles;
+    uint64_t totalInstructions;
+    byte nmiPending;
+    byte irqLines;
+    byte padding[6];
+};
+
+struct PpuState {
+    PpuRegisters registers;
+    uint16_t v;
+    uint16_t t;
+    byte x;
+    byte w;
+    byte readBuffer;
+    byte openBus;
+    uint16_t scanline;
+    uint16_t dot;
+    uint16_t renderedX;
+    uint16_t scrollBaseX;
+    uint16_t scrollBase;
+    byte oddFrame;
+    byte padding;
+    uint32_t frameCount;
+    byte nametablePages[4];
+    byte oam[0x100];
+    byte palette[0x20];
+    byte ram[PPU_RAM_SIZE];
+};
+
+// opaque to everything but the mapper that wrote it
+struct MapperState {
+    byte data[MAPPER_STATE_SIZE];
+};
+
+// Everything needed to resume emulation, in one flat block with no pointers, so that taking or
+// restoring a snapshot is a copy of a few tens of KiB. Any change to the layout must bump SAVESTATE_VERSION.
+struct SystemState {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    int32_t mapperNumber;
+
+    CpuState cpu;
+    PpuState ppu;
+    MapperState mapper;
+
+    byte cpuRam[CPU_RAM_SIZE];
+    byte prgRam[PRG_RAM_SIZE];
+    // left zeroed for carts with CHR ROM
+    byte chrRam[CHR_RAM_SIZE];
+};
+
+static_assert(std::is_trivially_copyable<SystemState>::value, "SystemState must be copyable with memcpy");
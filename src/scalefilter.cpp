@@ -0,0 +1,400 @@
+#include <cstdlib>
+#include "scalefilter.h"
+#include "rowpool.h"
+#include "pixelkernels.h"
+#include "ppu.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCALE_SSE2
+#include <emmintrin.h>
+#endif
+
+// 2xBR looks two pixels out in each direction
+const unsigned SCALE_PADDING = 2;
+const unsigned SCALE_PADDED_WIDTH = PPU_WIDTH + SCALE_PADDING * 2;
+const unsigned SCALE_PADDED_HEIGHT = PPU_HEIGHT + SCALE_PADDING * 2;
+
+// colours closer than this count as the same edge for 2xBR
+const int XBR_EQUAL_THRESHOLD = 155;
+
+static const char *scaleFilterNames[ScaleFilterType_Count] = { "scale2x", "scale3x", "xbr2x" };
+static const unsigned scaleFilterScales[ScaleFilterType_Count] = { 2, 3, 2 };
+
+ScaleFilter::ScaleFilter(int type, unsigned threads) {
+    this->type = type;
+    this->scale = scaleFilterScales[type];
+    this->width = PPU_WIDTH * this->scale;
+    this->height = PPU_HEIGHT * this->scale;
+    this->output = new uint32_t[this->width * this->height];
+    this->padded = new uint16_t[SCALE_PADDED_WIDTH * SCALE_PADDED_HEIGHT];
+
+    this->kernels = getPixelKernels();
+    this->palette = new uint32_t[RGBA_PALETTE_SIZE];
+    buildRgbaPalette(this->palette);
+
+    // Hyllian's weighting of the differences in Y, U and V
+    int yuv[RGBA_PALETTE_SIZE][3];
+    for (unsigned i = 0; i < RGBA_PALETTE_SIZE; i++) {
+        int r = this->palette[i] & 0xFF;
+        int g = (this->palette[i] >> 8) & 0xFF;
+        int b = (this->palette[i] >> 16) & 0xFF;
+        yuv[i][0] = (299 * r + 587 * g + 114 * b) / 1000;
+        yuv[i][1] = (-169 * r - 331 * g + 500 * b) / 1000;
+        yuv[i][2] = (500 * r - 419 * g - 81 * b) / 1000;
+    }
+
+    this->distances = new uint16_t[RGBA_PALETTE_SIZE * RGBA_PALETTE_SIZE];
+    for (unsigned i = 0; i < RGBA_PALETTE_SIZE; i++) {
+        for (unsigned j = 0; j < RGBA_PALETTE_SIZE; j++) {
+            int distance = std::abs(yuv[i][0] - yuv[j][0]) * 48 + std::abs(yuv[i][1] - yuv[j][1]) * 7 + std::abs(yuv[i][2] - yuv[j][2]) * 6;
+            this->distances[i * RGBA_PALETTE_SIZE + j] = static_cast<uint16_t>(distance);
+        }
+    }
+
+    this->pool = new RowPool(threads);
+    this->scratch = new uint16_t[this->pool->getThreadCount() * this->width * this->scale];
+}
+
+ScaleFilter::~ScaleFilter() {
+    delete pool;
+    delete[] scratch;
+    delete[] distances;
+    delete[] palette;
+    delete[] padded;
+    delete[] output;
+}
+
+unsigned ScaleFilter::getThreadCount() const {
+    return pool->getThreadCount();
+}
+
+const char *ScaleFilter::getName(int type) {
+    if (type < 0 || type >= ScaleFilterType_Count) {
+        return nullptr;
+    }
+    return scaleFilterNames[type];
+}
+
+const uint32_t *ScaleFilter::apply(const uint16_t *pixels, unsigned frameNumber) {
+    for (unsigned y = 0; y < SCALE_PADDED_HEIGHT; y++) {
+        unsigned inY = y < SCALE_PADDING ? 0 : (y - SCALE_PADDING >= PPU_HEIGHT ? PPU_HEIGHT - 1 : y - SCALE_PADDING);
+        const uint16_t *in = pixels + inY * PPU_WIDTH;
+        uint16_t *out = padded + y * SCALE_PADDED_WIDTH;
+
+        for (unsigned x = 0; x < SCALE_PADDING; x++) {
+            out[x] = in[0];
+            out[SCALE_PADDED_WIDTH - 1 - x] = in[PPU_WIDTH - 1];
+        }
+        for (unsigned x = 0; x < PPU_WIDTH; x++) {
+            out[SCALE_PADDING + x] = in[x] & 0x1FF;
+        }
+    }
+
+    pool->run(PPU_HEIGHT, filterRows, this);
+    return output;
+}
+
+void ScaleFilter::filterRows(unsigned start, unsigned end, unsigned worker, void *userData) {
+    ScaleFilter *filter = (ScaleFilter *)userData;
+    uint16_t *scratch = filter->scratch + worker * filter->width * filter->scale;
+
+    for (unsigned y = start; y < end; y++) {
+        uint32_t *out = filter->output + y * filter->scale * filter->width;
+        if (filter->type == ScaleFilterType_Xbr2x) {
+            filter->xbrRow(y, out);
+        } else {
+            filter->scaleRow(y, out, scratch);
+        }
+    }
+}
+
+// Scale2x: each pixel becomes 2x2, and a corner takes its two neighbours' colour when they match
+// each other but not the other two neighbours. B, D, F and H are above, left, right and below.
+static void scale2xRow(const uint16_t *in, int stride, uint16_t *top, uint16_t *bottom, unsigned count) {
+    unsigned x = 0;
+
+#ifdef SCALE_SSE2
+    for (; x + 8 <= count; x += 8) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x - stride));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x - 1));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x));
+        __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x + 1));
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x + stride));
+
+        __m128i db = _mm_cmpeq_epi16(d, b);
+        __m128i bf = _mm_cmpeq_epi16(b, f);
+        __m128i dh = _mm_cmpeq_epi16(d, h);
+        __m128i hf = _mm_cmpeq_epi16(h, f);
+
+        // x & ~y & ~z is andnot(y | z, x)
+        __m128i c0 = _mm_andnot_si128(_mm_or_si128(bf, dh), db);
+        __m128i c1 = _mm_andnot_si128(_mm_or_si128(db, hf), bf);
+        __m128i c2 = _mm_andnot_si128(_mm_or_si128(db, hf), dh);
+        __m128i c3 = _mm_andnot_si128(_mm_or_si128(dh, bf), hf);
+
+        __m128i e0 = _mm_or_si128(_mm_and_si128(c0, d), _mm_andnot_si128(c0, e));
+        __m128i e1 = _mm_or_si128(_mm_and_si128(c1, f), _mm_andnot_si128(c1, e));
+        __m128i e2 = _mm_or_si128(_mm_and_si128(c2, d), _mm_andnot_si128(c2, e));
+        __m128i e3 = _mm_or_si128(_mm_and_si128(c3, f), _mm_andnot_si128(c3, e));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(top + x * 2), _mm_unpacklo_epi16(e0, e1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(top + x * 2 + 8), _mm_unpackhi_epi16(e0, e1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(bottom + x * 2), _mm_unpacklo_epi16(e2, e3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(bottom + x * 2 + 8), _mm_unpackhi_epi16(e2, e3));
+    }
+#endif
+
+    for (; x < count; x++) {
+        const uint16_t *p = in + x;
+        uint16_t b = p[-stride], d = p[-1], e = p[0], f = p[1], h = p[stride];
+
+        top[x * 2] = d == b && b != f && d != h ? d : e;
+        top[x * 2 + 1] = b == f && b != d && f != h ? f : e;
+        bottom[x * 2] = d == h && d != b && h != f ? d : e;
+        bottom[x * 2 + 1] = h == f && d != h && b != f ? f : e;
+    }
+}
+
+// Scale3x: as Scale2x for the corners, and the edges between them also look at the diagonals
+//   A B C
+//   D E F
+//   G H I
+static void scale3xRow(const uint16_t *in, int stride, uint16_t *top, uint16_t *middle, uint16_t *bottom, unsigned count) {
+    unsigned x = 0;
+
+#ifdef SCALE_SSE2
+    for (; x + 8 <= count; x += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x - stride - 1));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x - stride));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x - stride + 1));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x - 1));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x));
+        __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x + 1));
+        __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x + stride - 1));
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x + stride));
+        __m128i i = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x + stride + 1));
+
+        __m128i db = _mm_cmpeq_epi16(d, b);
+        __m128i bf = _mm_cmpeq_epi16(b, f);
+        __m128i dh = _mm_cmpeq_epi16(d, h);
+        __m128i hf = _mm_cmpeq_epi16(h, f);
+        __m128i ea = _mm_cmpeq_epi16(e, a);
+        __m128i ec = _mm_cmpeq_epi16(e, c);
+        __m128i eg = _mm_cmpeq_epi16(e, g);
+        __m128i ei = _mm_cmpeq_epi16(e, i);
+
+        __m128i c0 = _mm_andnot_si128(_mm_or_si128(bf, dh), db);
+        __m128i c2 = _mm_andnot_si128(_mm_or_si128(db, hf), bf);
+        __m128i c6 = _mm_andnot_si128(_mm_or_si128(db, hf), dh);
+        __m128i c8 = _mm_andnot_si128(_mm_or_si128(dh, bf), hf);
+        __m128i c1 = _mm_or_si128(_mm_andnot_si128(ec, c0), _mm_andnot_si128(ea, c2));
+        __m128i c3 = _mm_or_si128(_mm_andnot_si128(eg, c0), _mm_andnot_si128(ea, c6));
+        __m128i c5 = _mm_or_si128(_mm_andnot_si128(ei, c2), _mm_andnot_si128(ec, c8));
+        __m128i c7 = _mm_or_si128(_mm_andnot_si128(ei, c6), _mm_andnot_si128(eg, c8));
+
+        // there's no three way interleave, so the rows are put together from a small buffer
+        alignas(16) uint16_t blocks[9][8];
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[0]), _mm_or_si128(_mm_and_si128(c0, d), _mm_andnot_si128(c0, e)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[1]), _mm_or_si128(_mm_and_si128(c1, b), _mm_andnot_si128(c1, e)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[2]), _mm_or_si128(_mm_and_si128(c2, f), _mm_andnot_si128(c2, e)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[3]), _mm_or_si128(_mm_and_si128(c3, d), _mm_andnot_si128(c3, e)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[4]), e);
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[5]), _mm_or_si128(_mm_and_si128(c5, f), _mm_andnot_si128(c5, e)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[6]), _mm_or_si128(_mm_and_si128(c6, d), _mm_andnot_si128(c6, e)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[7]), _mm_or_si128(_mm_and_si128(c7, h), _mm_andnot_si128(c7, e)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(blocks[8]), _mm_or_si128(_mm_and_si128(c8, f), _mm_andnot_si128(c8, e)));
+
+        for (unsigned j = 0; j < 8; j++) {
+            uint16_t *outTop = top + (x + j) * 3;
+            uint16_t *outMiddle = middle + (x + j) * 3;
+            uint16_t *outBottom = bottom + (x + j) * 3;
+            outTop[0] = blocks[0][j];
+            outTop[1] = blocks[1][j];
+            outTop[2] = blocks[2][j];
+            outMiddle[0] = blocks[3][j];
+            outMiddle[1] = blocks[4][j];
+            outMiddle[2] = blocks[5][j];
+            outBottom[0] = blocks[6][j];
+            outBottom[1] = blocks[7][j];
+            outBottom[2] = blocks[8][j];
+        }
+    }
+#endif
+
+    for (; x < count; x++) {
+        const uint16_t *p = in + x;
+        uint16_t a = p[-stride - 1], b = p[-stride], c = p[-stride + 1];
+        uint16_t d = p[-1], e = p[0], f = p[1];
+        uint16_t g = p[stride - 1], h = p[stride], i = p[stride + 1];
+
+        bool c0 = d == b && b != f && d != h;
+        bool c2 = b == f && b != d && f != h;
+        bool c6 = d == h && d != b && h != f;
+        bool c8 = h == f && d != h && b != f;
+
+        uint16_t *outTop = top + x * 3;
+        uint16_t *outMiddle = middle + x * 3;
+        uint16_t *outBottom = bottom + x * 3;
+        outTop[0] = c0 ? d : e;
+        outTop[1] = (c0 && e != c) || (c2 && e != a) ? b : e;
+        outTop[2] = c2 ? f : e;
+        outMiddle[0] = (c0 && e != g) || (c6 && e != a) ? d : e;
+        outMiddle[1] = e;
+        outMiddle[2] = (c2 && e != i) || (c8 && e != c) ? f : e;
+        outBottom[0] = c6 ? d : e;
+        outBottom[1] = (c6 && e != i) || (c8 && e != g) ? h : e;
+        outBottom[2] = c8 ? f : e;
+    }
+}
+
+void ScaleFilter::scaleRow(unsigned y, uint32_t *out, uint16_t *scratch) {
+    const uint16_t *in = padded + (y + SCALE_PADDING) * SCALE_PADDED_WIDTH + SCALE_PADDING;
+
+    if (scale == 2) {
+        scale2xRow(in, SCALE_PADDED_WIDTH, scratch, scratch + width, PPU_WIDTH);
+    } else {
+        scale3xRow(in, SCALE_PADDED_WIDTH, scratch, scratch + width, scratch + width * 2, PPU_WIDTH);
+    }
+
+    kernels->convertToRgba(scratch, out, width * scale, palette);
+}
+
+// moves amount/256 of the way from one colour to another
+static inline uint32_t blendColor(uint32_t from, uint32_t to, uint32_t amount) {
+    uint32_t redBlue = ((((to & 0xFF00FF) - (from & 0xFF00FF)) * amount + ((from & 0xFF00FF) << 8)) & 0xFF00FF00) >> 8;
+    uint32_t greenAlpha = (((to >> 8) & 0xFF00FF) - ((from >> 8) & 0xFF00FF)) * amount + (((from >> 8) & 0xFF00FF) << 8);
+    return redBlue | (greenAlpha & 0xFF00FF00);
+}
+
+struct XbrPixel {
+    const uint16_t *distances;
+    const uint32_t *palette;
+    uint32_t *out[4];       // top left, top right, bottom left, bottom right
+
+    int distance(uint16_t a, uint16_t b) const {
+        return distances[a * RGBA_PALETTE_SIZE + b];
+    }
+
+    bool equal(uint16_t a, uint16_t b) const {
+        return distance(a, b) < XBR_EQUAL_THRESHOLD;
+    }
+
+    // Hyllian's 2xBR edge rule for one corner, with the neighbourhood rotated so the corner being
+    // decided is always the bottom right one (n3), next to n1 on its right and n2 below it:
+    //          A1 B1 C1
+    //       A0 A  B  C  C4
+    //       D0 D  E  F  F4
+    //       G0 G  H  I  I4
+    //          G5 H5 I5
+    void corner(uint16_t e, uint16_t i, uint16_t h, uint16_t f, uint16_t g, uint16_t c, uint16_t d, uint16_t b,
+                uint16_t f4, uint16_t i4, uint16_t h5, uint16_t i5, unsigned n1, unsigned n2, unsigned n3) const {
+        if (e == h || e == f) {
+            return;
+        }
+
+        int edgeE = distance(e, c) + distance(e, g) + distance(i, h5) + distance(i, f4) + (distance(h, f) << 2);
+        int edgeI = distance(h, d) + distance(h, i5) + distance(f, i4) + distance(f, b) + (distance(e, i) << 2);
+        uint32_t pixel = palette[distance(e, f) <= distance(e, h) ? f : h];
+
+        if (edgeE < edgeI
+            && ((!equal(f, b) && !equal(h, d)) || (equal(e, i) && !equal(f, i4) && !equal(h, i5)) || equal(e, g) || equal(e, c))) {
+            int shallow = distance(f, g);
+            int steep = distance(h, c);
+            bool left = (shallow << 1) <= steep && e != g && d != g;
+            bool up = shallow >= (steep << 1) && e != c && b != c;
+
+            if (left && up) {
+                *out[n3] = blendColor(*out[n3], pixel, 224);
+                *out[n2] = blendColor(*out[n2], pixel, 64);
+                *out[n1] = *out[n2];
+            } else if (left) {
+                *out[n3] = blendColor(*out[n3], pixel, 192);
+                *out[n2] = blendColor(*out[n2], pixel, 64);
+            } else if (up) {
+                *out[n3] = blendColor(*out[n3], pixel, 192);
+                *out[n1] = blendColor(*out[n1], pixel, 64);
+            } else {
+                *out[n3] = blendColor(*out[n3], pixel, 128);
+            }
+        } else if (edgeE <= edgeI) {
+            *out[n3] = blendColor(*out[n3], pixel, 128);
+        }
+    }
+};
+
+void ScaleFilter::xbrRow(unsigned y, uint32_t *out) {
+    const int s = SCALE_PADDED_WIDTH;
+    const uint16_t *in = padded + (y + SCALE_PADDING) * s + SCALE_PADDING;
+    uint32_t *top = out;
+    uint32_t *bottom = out + width;
+
+    XbrPixel pixel;
+    pixel.distances = distances;
+    pixel.palette = palette;
+
+    unsigned x = 0;
+    while (x < PPU_WIDTH) {
+        // a corner is only considered when the pixel differs from both neighbours beside it, so
+        // pixels matching both neighbours across one axis are copied out without looking any further
+        unsigned plain = 0;
+
+#ifdef SCALE_SSE2
+        if (x + 8 <= PPU_WIDTH) {
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x - s));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x - 1));
+            __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x));
+            __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x + 1));
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + x + s));
+
+            __m128i eb = _mm_cmpeq_epi16(e, b);
+            __m128i ed = _mm_cmpeq_epi16(e, d);
+            __m128i ef = _mm_cmpeq_epi16(e, f);
+            __m128i eh = _mm_cmpeq_epi16(e, h);
+            __m128i flat = _mm_or_si128(_mm_and_si128(eb, eh), _mm_and_si128(ed, ef));
+            if (_mm_movemask_epi8(flat) == 0xFFFF) {
+                plain = 8;
+            }
+        }
+#endif
+
+        if (plain == 0) {
+            const uint16_t *p = in + x;
+            uint16_t b = p[-s], d = p[-1], e = p[0], f = p[1], h = p[s];
+            if ((e == b && e == h) || (e == d && e == f)) {
+                plain = 1;
+            }
+        }
+
+        if (plain > 0) {
+            for (unsigned j = x; j < x + plain; j++) {
+                uint32_t color = palette[in[j]];
+                top[j * 2] = top[j * 2 + 1] = color;
+                bottom[j * 2] = bottom[j * 2 + 1] = color;
+            }
+            x += plain;
+            continue;
+        }
+
+        const uint16_t *p = in + x;
+        uint16_t a1 = p[-2 * s - 1], b1 = p[-2 * s], c1 = p[-2 * s + 1];
+        uint16_t a0 = p[-s - 2], a = p[-s - 1], b = p[-s], c = p[-s + 1], c4 = p[-s + 2];
+        uint16_t d0 = p[-2], d = p[-1], e = p[0], f = p[1], f4 = p[2];
+        uint16_t g0 = p[s - 2], g = p[s - 1], h = p[s], i = p[s + 1], i4 = p[s + 2];
+        uint16_t g5 = p[2 * s - 1], h5 = p[2 * s], i5 = p[2 * s + 1];
+
+        uint32_t color = palette[e];
+        top[x * 2] = top[x * 2 + 1] = color;
+        bottom[x * 2] = bottom[x * 2 + 1] = color;
+        pixel.out[0] = &top[x * 2];
+        pixel.out[1] = &top[x * 2 + 1];
+        pixel.out[2] = &bottom[x * 2];
+        pixel.out[3] = &bottom[x * 2 + 1];
+
+        pixel.corner(e, i, h, f, g, c, d, b, f4, i4, h5, i5, 1, 2, 3);
+        pixel.corner(e, c, f, b, i, a, h, d, b1, c1, f4, c4, 0, 3, 1);
+        pixel.corner(e, a, b, d, c, g, f, h, d0, a0, b1, a1, 2, 1, 0);
+        pixel.corner(e, g, d, h, a, i, b, f, h5, g5, d0, g0, 3, 0, 2);
+
+        x++;
+    }
+}
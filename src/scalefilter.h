@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include "videofilter.h"
+
+class RowPool;
+struct PixelKernels;
+
+enum {
+    ScaleFilterType_Scale2x,
+    ScaleFilterType_Scale3x,
+    ScaleFilterType_Xbr2x,
+
+    ScaleFilterType_Count,
+};
+
+// Pixel art scalers, which smooth diagonal edges without blurring anything else. Scale2x and
+// Scale3x only compare pixels for equality, so they run on the PPU's indexed pixels and convert
+// the result to RGBA afterwards; 2xBR weighs colour differences and blends, so it works in RGBA.
+// Rows are spread across a RowPool.
+class ScaleFilter : public VideoFilter {
+public:
+    // threads as for RowPool
+    ScaleFilter(int type, unsigned threads);
+    ~ScaleFilter();
+
+    unsigned getOutputWidth() const override { return this->width; }
+    unsigned getOutputHeight() const override { return this->height; }
+
+    const uint32_t *apply(const uint16_t *pixels, unsigned frameNumber) override;
+
+    unsigned getThreadCount() const;
+
+    // e.g. "scale2x", or nullptr if there's no such type
+    static const char *getName(int type);
+
+private:
+    static void filterRows(unsigned start, unsigned end, unsigned worker, void *userData);
+    void scaleRow(unsigned y, uint32_t *out, uint16_t *scratch);
+    void xbrRow(unsigned y, uint32_t *out);
+
+    int type;
+    unsigned scale;
+    unsigned width;
+    unsigned height;
+    uint32_t *output;
+
+    // the input with a border of copies of the edge pixels, so every neighbourhood is in bounds
+    uint16_t *padded;
+
+    const PixelKernels *kernels;
+    uint32_t *palette;
+    // how different 2xBR sees every pair of colours
+    uint16_t *distances;
+
+    RowPool *pool;
+    // one line of indexed output per worker, before it's converted to RGBA
+    uint16_t *scratch;
+};
@@ -1,42 +1,171 @@
-#include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include "system.h"
 #include "rom.h"
 #include "cpubus.h"
 #include "cpu.h"
 #include "ppu.h"
+#include "mapper.h"
+#include "ppubus.h"
+#include "savestate.h"
+
+// NTSC: 3 PPU dots per CPU cycle
+const unsigned PPU_DOTS_PER_CPU_CYCLE = 3;
 
 System::System() {
     this->bus = new CpuBus(this);
+    this->rom = nullptr;
+    this->mapper = nullptr;
+    this->romDatabase = nullptr;
     this->cpu = new Cpu(this);
     this->ppu = new Ppu(this);
+    this->ppuCycle = cpu->getTotalCycles();
 };
 
 System::~System() {
     delete ppu;
     delete cpu;
     delete bus;
+    delete mapper;
+    delete rom;
 }
 
-bool System::loadRom(const char *path) {
+const char *System::loadRom(const char *path) {
     this->rom = new Rom(this);
-    bool v = rom->load(path);
-    Mapper *mapper = this->rom->createMapper();
+    const char *error = rom->load(path, romDatabase);
+    if (error) {
+        return error;
+    }
+
+    this->mapper = this->rom->createMapper();
+    if (!mapper) {
+        return "unsupported mapper";
+    }
+
     this->bus->setCartridgeMapper(mapper);
-    return v;
+    this->ppu->getBus()->setCartridgeMapper(mapper);
+    this->ppu->getBus()->setMirroring(rom->mirroring);
+    this->ppu->setCartridge(mapper, &rom->chrCache);
+    this->mapper->reset();
+    this->cpu->invalidateBlocks(0x8000, 0xFFFF);
+    return nullptr;
 }
 
 void System::start() {
-    bus->mapMemory(0x2000, 0x4000, (byte *)&ppu->registers, sizeof(PpuRegisters));
+    bus->setPpu(ppu);
 
     cpu->start();
-    printf("Started\n");
+    ppuCycle = cpu->getTotalCycles();
 }
 
 void System::reset() {
     cpu->reset();
-    printf("Reset\n");
 }
 
 void System::tick() {
-    cpu->step();
+    runCycles(1);
+}
+
+// The PPU is left behind while the CPU runs, and only caught up when the CPU touches one of its
+// registers, or when it's due to raise an NMI, so code that never looks at the PPU doesn't pay
+// for it every cycle. The PPU ends up in the same state as if the two had run in lockstep.
+// A mapper's scanline IRQ is another deadline, and anything that moves it ends the CPU's run early.
+void System::runCycles(unsigned cycles) {
+    while (cycles > 0) {
+        unsigned untilDeadline = ppu->getDotsUntilVblank();
+        unsigned clocks = mapper ? mapper->getClocksUntilIrq() : 0;
+        if (clocks > 0) {
+            unsigned untilIrq = ppu->getDotsUntilScanlineClock(clocks);
+            if (untilIrq > 0 && untilIrq < untilDeadline) {
+                untilDeadline = untilIrq;
+            }
+        }
+
+        unsigned untilCycle = (untilDeadline + PPU_DOTS_PER_CPU_CYCLE - 1) / PPU_DOTS_PER_CPU_CYCLE;
+        unsigned batch = untilCycle < cycles ? untilCycle : cycles;
+
+        unsigned start = cpu->getTotalCycles();
+        cpu->run(batch);
+        syncPpu();
+
+        unsigned ran = cpu->getTotalCycles() - start;
+        cycles -= ran < cycles ? ran : cycles;
+    }
+}
+
+// brings the PPU up to the cycle the CPU is on
+void System::syncPpu() {
+    unsigned cycles = cpu->getTotalCycles() - ppuCycle;
+    if (cycles > 0) {
+        ppuCycle += cycles;
+        ppu->run(cycles * PPU_DOTS_PER_CPU_CYCLE);
+    }
+}
+
+// runs until the PPU wraps around to the start of the next frame, with the last one complete
+void System::runFrame() {
+    unsigned frame = ppu->getFrameCount();
+    while (ppu->getFrameCount() == frame) {
+        runCycles((ppu->getDotsUntilFrameEnd() + PPU_DOTS_PER_CPU_CYCLE - 1) / PPU_DOTS_PER_CPU_CYCLE);
+    }
+}
+
+unsigned System::getFrameCount() const {
+    return ppu->getFrameCount();
+}
+
+void System::saveState(SystemState *state) const {
+    memcpy(state->magic, SAVESTATE_MAGIC, sizeof(state->magic));
+    state->version = SAVESTATE_VERSION;
+    state->size = sizeof(SystemState);
+    state->mapperNumber = rom ? rom->mapperNumber : -1;
+
+    cpu->saveState(&state->cpu);
+    ppu->saveState(&state->ppu);
+    if (mapper) {
+        mapper->saveState(&state->mapper);
+    } else {
+        memset(&state->mapper, 0, sizeof(MapperState));
+    }
+
+    memcpy(state->cpuRam, bus->getRam(), CPU_RAM_SIZE);
+    if (mapper) {
+        memcpy(state->prgRam, mapper->getPrgRam(), PRG_RAM_SIZE);
+    } else {
+        memset(state->prgRam, 0, PRG_RAM_SIZE);
+    }
+    if (rom && rom->hasChrRam) {
+        memcpy(state->chrRam, rom->chrRam, CHR_RAM_SIZE);
+    } else {
+        memset(state->chrRam, 0, CHR_RAM_SIZE);
+    }
+}
+
+bool System::loadState(const SystemState *state) {
+    if (memcmp(state->magic, SAVESTATE_MAGIC, sizeof(state->magic)) != 0
+        || state->version != SAVESTATE_VERSION
+        || state->size != sizeof(SystemState)
+        || state->mapperNumber != (rom ? rom->mapperNumber : -1)) {
+        return false;
+    }
+
+    cpu->loadState(&state->cpu);
+    ppu->loadState(&state->ppu);
+    if (mapper) {
+        mapper->loadState(&state->mapper);
+    }
+
+    memcpy(bus->getRam(), state->cpuRam, CPU_RAM_SIZE);
+    if (mapper) {
+        memcpy(mapper->getPrgRam(), state->prgRam, PRG_RAM_SIZE);
+    }
+    if (rom && rom->hasChrRam) {
+        memcpy(rom->chrRam, state->chrRam, CHR_RAM_SIZE);
+        rom->chrCache.refresh(rom->chrRam);
+    }
+    ppuCycle = cpu->getTotalCycles();
+
+    // both RAM and the mapped PRG banks may have changed under any decoded code
+    cpu->invalidateBlocks(0x0000, 0xFFFF);
+    return true;
 }
\ No newline at end of file
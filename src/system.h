@@ -4,29 +4,52 @@ class CpuBus;
 class Rom;
 class Cpu;
 class Ppu;
+class Mapper;
+class RomDatabase;
+struct SystemState;
 
 class System {
 public:
     System();
     ~System();
 
-    bool loadRom(const char *path);
+    // returns why the ROM can't be run or null, and prints nothing, so many can load at once
+    const char *loadRom(const char *path);
+    // headers of ROMs loaded from then on are corrected from the database, which has to outlive them
+    void setRomDatabase(const RomDatabase *database) { this->romDatabase = database; }
 
     void start();
     void reset();
 
     void tick();
+    void runCycles(unsigned cycles);
+    void runFrame();
+
+    // the PPU runs behind the CPU until something needs it to be current
+    void syncPpu();
+
+    // snapshots are only valid to load into a System running the same ROM
+    void saveState(SystemState *state) const;
+    bool loadState(const SystemState *state);
+
+    unsigned getFrameCount() const;
 
     CpuBus *getBus() const { return this->bus; }
     Rom *getRom() const { return this->rom; }
+    Mapper *getMapper() const { return this->mapper; }
     Cpu *getCpu() const { return this->cpu; }
     Ppu *getPpu() const { return this->ppu; }
 
 private:
     CpuBus *bus;
     Rom *rom;
+    Mapper *mapper;
     Cpu *cpu;
     Ppu *ppu;
+    const RomDatabase *romDatabase;
+
+    // CPU cycle the PPU has been run up to
+    unsigned ppuCycle;
 };
 
 
@@ -0,0 +1,39 @@
+// Converts a binary trace written by Cpu::startTrace into the text format of the old cpu.log
+
+#include <cstdio>
+#include "tracelog.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace file> [output file]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (argc >= 3) {
+        out = fopen(argv[2], "w");
+        if (!out) {
+            fprintf(stderr, "Failed to open %s\n", argv[2]);
+            fclose(in);
+            return 1;
+        }
+    }
+
+    bool ok = TraceLog::decode(in, out);
+    if (!ok) {
+        fprintf(stderr, "%s is not a trace file\n", argv[1]);
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    fclose(in);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include <cstring>
+#include <chrono>
+#include "tracelog.h"
+#include "cpudefs.h"
+
+#define BYTE_TO_BINARY_PATTERN "%c%c%c%c%c%c%c%c"
+#define BYTE_TO_BINARY(byte)  \
+  (byte & 0x80 ? '1' : '0'), \
+  (byte & 0x40 ? '1' : '0'), \
+  (byte & 0x20 ? '1' : '0'), \
+  (byte & 0x10 ? '1' : '0'), \
+  (byte & 0x08 ? '1' : '0'), \
+  (byte & 0x04 ? '1' : '0'), \
+  (byte & 0x02 ? '1' : '0'), \
+  (byte & 0x01 ? '1' : '0')
+
+TraceLog::TraceLog() : head(0), tail(0), running(false) {
+    this->records = new TraceRecord[CAPACITY];
+    this->file = nullptr;
+}
+
+TraceLog::~TraceLog() {
+    close();
+    delete[] records;
+}
+
+bool TraceLog::open(const char *path, const CpuInstruction *instructions) {
+    close();
+
+    file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(TraceHeader));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+
+    for (unsigned i = 0; i < 0x100; i++) {
+        const CpuInstruction *instruction = &instructions[i];
+        if (instruction->operationName != nullptr) {
+            strncpy(header.operationNames[i], instruction->operationName, TRACE_NAME_LENGTH - 1);
+        }
+        if (instruction->addressingModeName != nullptr) {
+            strncpy(header.addressingModeNames[i], instruction->addressingModeName, TRACE_NAME_LENGTH - 1);
+        }
+    }
+
+    fwrite(&header, sizeof(TraceHeader), 1, file);
+
+    head = 0;
+    tail = 0;
+    running = true;
+    writer = std::thread(&TraceLog::drain, this);
+
+    return true;
+}
+
+void TraceLog::close() {
+    if (!file) {
+        return;
+    }
+
+    running = false;
+    writer.join();
+
+    fclose(file);
+    file = nullptr;
+}
+
+void TraceLog::push(const TraceRecord &record) {
+    unsigned h = head.load(std::memory_order_relaxed);
+
+    // the writer has fallen a whole buffer behind, wait for it rather than lose records
+    while (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+        std::this_thread::yield();
+    }
+
+    records[h & (CAPACITY - 1)] = record;
+    head.store(h + 1, std::memory_order_release);
+}
+
+void TraceLog::drain() {
+    unsigned t = tail.load(std::memory_order_relaxed);
+
+    while (true) {
+        // checked before head, so anything pushed before close() is still written out
+        bool stopping = !running.load(std::memory_order_acquire);
+        unsigned h = head.load(std::memory_order_acquire);
+
+        if (t == h) {
+            if (stopping) {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // write up to the newest record or the end of the buffer, whichever comes first
+        unsigned start = t & (CAPACITY - 1);
+        unsigned count = h - t;
+        if (start + count > CAPACITY) {
+            count = CAPACITY - start;
+        }
+
+        fwrite(&records[start], sizeof(TraceRecord), count, file);
+        t += count;
+        tail.store(t, std::memory_order_release);
+    }
+
+    fflush(file);
+}
+
+bool TraceLog::decode(FILE *in, FILE *out) {
+    TraceHeader header;
+    if (fread(&header, sizeof(TraceHeader), 1, in) != 1) {
+        return false;
+    }
+
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 || header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord)) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < 0x100; i++) {
+        header.operationNames[i][TRACE_NAME_LENGTH - 1] = '\0';
+        header.addressingModeNames[i][TRACE_NAME_LENGTH - 1] = '\0';
+    }
+
+    TraceRecord record;
+    while (fread(&record, sizeof(TraceRecord), 1, in) == 1) {
+        if (record.flags & TraceRecordFlag_Illegal) {
+            fprintf(out, "%04X Illegal instruction %02X\n", record.pc, record.opcode);
+            continue;
+        }
+
+        char value[3] = "--";
+        if (!(record.flags & TraceRecordFlag_NoOperandValue)) {
+            snprintf(value, sizeof(value), "%02X", record.operandValue);
+        }
+
+        fprintf(out, "%04X %02X (%s %s with %04X = %s) cycle: %u, A: %02X, X: %02X, Y: %02X, S: %02X, P: " BYTE_TO_BINARY_PATTERN " %02X\n",
+                record.pc, record.opcode,
+                header.operationNames[record.opcode], header.addressingModeNames[record.opcode],
+                record.operandAddress, value, record.cycle,
+                record.a, record.x, record.y, record.s, BYTE_TO_BINARY(record.p), record.p);
+    }
+
+    return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include "armadadef.h"
+
+struct CpuInstruction;
+
+const char TRACE_MAGIC[4] = { 'A', 'N', 'T', 'R' };
+const uint32_t TRACE_VERSION = 1;
+const unsigned TRACE_NAME_LENGTH = 8;
+
+// Written once at the start of a trace file, followed by TraceRecords until the end of the file.
+// The opcode names are stored so the decoder doesn't need its own copy of the instruction table.
+struct TraceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t padding;
+    char operationNames[0x100][TRACE_NAME_LENGTH];
+    char addressingModeNames[0x100][TRACE_NAME_LENGTH];
+};
+
+enum {
+    TraceRecordFlag_Illegal                     = (1U << 0U),
+    // the operand is a PPU/APU/IO register, which the trace can't read without side effects
+    TraceRecordFlag_NoOperandValue              = (1U << 1U),
+};
+
+// one executed instruction, with the registers as they were before it ran
+struct TraceRecord {
+    uint32_t cycle;
+    uint16_t pc;
+    uint16_t operandAddress;
+    byte opcode;
+    byte operandValue;
+    byte a;
+    byte x;
+    byte y;
+    byte s;
+    byte p;
+    byte flags;
+};
+
+// Binary instruction trace. Records go into a single-producer/single-consumer ring buffer that
+// a background thread drains to disk, so the emulation thread never formats or writes anything.
+class TraceLog {
+public:
+    TraceLog();
+    ~TraceLog();
+
+    bool open(const char *path, const CpuInstruction *instructions);
+    void close();
+
+    void push(const TraceRecord &record);
+
+    // converts a binary trace back into the text format used for diffing against nestest.log
+    static bool decode(FILE *in, FILE *out);
+
+private:
+    void drain();
+
+    static const unsigned CAPACITY = 1U << 16U;
+
+    TraceRecord *records;
+    std::atomic<unsigned> head;     // next record to be written by push()
+    std::atomic<unsigned> tail;     // next record to be written to disk
+    std::atomic<bool> running;
+
+    FILE *file;
+    std::thread writer;
+};
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+
+// A post-processing stage between the PPU framebuffer and a video sink, turning indexed pixels
+// into RGBA at whatever size the filter produces
+class VideoFilter {
+public:
+    virtual ~VideoFilter() = default;
+
+    virtual unsigned getOutputWidth() const = 0;
+    virtual unsigned getOutputHeight() const = 0;
+
+    // the result stays valid until the next call
+    virtual const uint32_t *apply(const uint16_t *pixels, unsigned frameNumber) = 0;
+};
@@ -0,0 +1,95 @@
+#include "videosink.h"
+#include <cstring>
+#include "framequeue.h"
+#include "pixelkernels.h"
+#include "videofilter.h"
+
+VideoSink::VideoSink() {
+    this->rgba = nullptr;
+    this->palette = nullptr;
+    this->filter = nullptr;
+    memset(this->presentedHashes, 0, sizeof(this->presentedHashes));
+    this->hasPresented = false;
+    memset(this->dirtyRows, 0, sizeof(this->dirtyRows));
+    this->submitted = 0;
+    this->dirtyRowTotal = 0;
+}
+
+VideoSink::~VideoSink() {
+    delete[] rgba;
+    delete[] palette;
+}
+
+void VideoSink::setFilter(VideoFilter *filter) {
+    this->filter = filter;
+    invalidate();
+}
+
+void VideoSink::submit(const uint16_t *pixels, const uint64_t *rowHashes, unsigned number) {
+    // a filtered row depends on more than its own pixels, so only unfiltered frames have clean rows
+    bool allDirty = !hasPresented || filter != nullptr;
+    unsigned dirtyCount = 0;
+    memset(dirtyRows, 0, sizeof(dirtyRows));
+
+    for (unsigned y = 0; y < PPU_HEIGHT; y++) {
+        uint64_t hash = rowHashes ? rowHashes[y] : hashScanline(pixels + y * PPU_WIDTH);
+        if (allDirty || hash != presentedHashes[y]) {
+            dirtyRows[y / 32] |= 1U << (y % 32);
+            dirtyCount++;
+        }
+        presentedHashes[y] = hash;
+    }
+
+    hasPresented = true;
+    submitted++;
+    dirtyRowTotal += dirtyCount;
+
+    VideoFrame frame;
+    frame.width = PPU_WIDTH;
+    frame.height = PPU_HEIGHT;
+    frame.number = number;
+    frame.indexed = pixels;
+    frame.rgba = nullptr;
+    frame.rgbaWidth = 0;
+    frame.rgbaHeight = 0;
+    frame.dirtyRows = dirtyRows;
+    frame.dirtyRowCount = dirtyCount;
+
+    if (filter) {
+        frame.rgba = filter->apply(pixels, number);
+        frame.rgbaWidth = filter->getOutputWidth();
+        frame.rgbaHeight = filter->getOutputHeight();
+    } else if (wantsRgba()) {
+        if (rgba == nullptr) {
+            rgba = new uint32_t[PPU_WIDTH * PPU_HEIGHT];
+            palette = new uint32_t[RGBA_PALETTE_SIZE];
+            buildRgbaPalette(palette);
+        }
+
+        // only the dirty rows, in runs, since the clean ones are still there from the last frame
+        const PixelKernels *kernels = getPixelKernels();
+        unsigned y = 0;
+        while (y < PPU_HEIGHT) {
+            if (!frame.isRowDirty(y)) {
+                y++;
+                continue;
+            }
+
+            unsigned end = y + 1;
+            while (end < PPU_HEIGHT && frame.isRowDirty(end)) {
+                end++;
+            }
+            kernels->convertToRgba(pixels + y * PPU_WIDTH, rgba + y * PPU_WIDTH, (end - y) * PPU_WIDTH, palette);
+            y = end;
+        }
+        frame.rgba = rgba;
+        frame.rgbaWidth = PPU_WIDTH;
+        frame.rgbaHeight = PPU_HEIGHT;
+    }
+
+    present(frame);
+}
+
+void VideoSink::submit(const Frame *frame) {
+    submit(frame->pixels, frame->rowHashes, frame->number);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include "armadadef.h"
+#include "ppu.h"
+
+struct Frame;
+class VideoFilter;
+
+// A finished frame as handed to a sink. indexed is always there, in the PPU's format of a 6-bit
+// colour with the emphasis bits above it; rgba is only filled in for sinks that ask for it, or
+// when a filter is set, in which case it's the filter's size rather than the PPU's.
+// Rows that are the same as in the last frame the sink presented are left clean in dirtyRows, so a
+// sink that keeps its own copy only needs to update the rest. Filtered frames are always all dirty.
+struct VideoFrame {
+    unsigned width;
+    unsigned height;
+    unsigned number;
+    const uint16_t *indexed;
+    const uint32_t *rgba;       // bytes in R, G, B, A order
+    unsigned rgbaWidth;
+    unsigned rgbaHeight;
+
+    const uint32_t *dirtyRows;  // one bit per PPU row
+    unsigned dirtyRowCount;
+
+    bool isRowDirty(unsigned y) const { return (dirtyRows[y / 32] >> (y % 32)) & 1; }
+};
+
+const unsigned DIRTY_ROW_WORDS = (PPU_HEIGHT + 31) / 32;
+
+// Where finished frames go: a window, files on disk, or nowhere at all
+class VideoSink {
+public:
+    VideoSink();
+    virtual ~VideoSink();
+
+    virtual bool init() { return true; }
+    virtual void shutdown() {}
+
+    // rowHashes as from Ppu::getRowHashes, or nullptr to have the sink hash the rows itself
+    void submit(const uint16_t *pixels, const uint64_t *rowHashes, unsigned number);
+    void submit(const Frame *frame);
+
+    // runs every frame through a filter before presenting it, or nullptr to present the PPU's
+    // pixels as they are; the sink doesn't take ownership
+    void setFilter(VideoFilter *filter);
+    VideoFilter *getFilter() const { return this->filter; }
+
+    // makes the next frame all dirty, for when whatever the sink kept of the last one has been lost
+    void invalidate() { this->hasPresented = false; }
+
+    unsigned getSubmittedCount() const { return this->submitted; }
+    uint64_t getDirtyRowTotal() const { return this->dirtyRowTotal; }
+
+protected:
+    // converting to RGBA costs a pass over the frame, so it's only done for sinks that need it
+    virtual bool wantsRgba() const { return false; }
+    virtual void present(const VideoFrame &frame) = 0;
+
+private:
+    uint32_t *rgba;
+    uint32_t *palette;
+    VideoFilter *filter;
+
+    // row hashes of the last frame presented
+    uint64_t presentedHashes[PPU_HEIGHT];
+    bool hasPresented;
+    uint32_t dirtyRows[DIRTY_ROW_WORDS];
+
+    unsigned submitted;
+    uint64_t dirtyRowTotal;
+};
+
+// throws every frame away, for measuring the emulation on its own
+class NullVideoSink : public VideoSink {
+public:
+    NullVideoSink() = default;
+
+protected:
+    void present(const VideoFrame &frame) override {}
+};